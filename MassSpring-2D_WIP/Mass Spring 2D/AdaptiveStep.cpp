@@ -0,0 +1,164 @@
+/*
+Adaptive step
+
+Step doubling: from the same state, one step of h and two steps of h / 2. Explicit Euler moves a
+particle by V * h + A * h^2 / 2 with A taken at the start of the step, so the positions of a single
+step are off by O(h^3) and the difference between the two results is too. Implicit Euler and XPBD take
+the velocity at the end of the step instead, which leaves them off by O(h^2). A step of h that left an
+error e would therefore have met the tolerance at about h * (tolerance / e)^(1/k), with k = 3 for
+explicit Euler and 2 for the others. Each body is measured with its own integrator's k and the
+shortest length any body asks for wins; the next step is that, shrunk a little for safety and limited
+to a factor of STEP_MAX_GROWTH either way, so one calm step cannot jump the length to the maximum and
+one bad step cannot send it to the minimum.
+
+Only what a step changes is put back after the whole step: the particles, and the sleep state of each
+body since that decides what the next step solves. Everything else a body keeps is rebuilt each step.
+With the state restored exactly, the two half steps kept are the same as stepping the saved state twice
+by h / 2, which is what the log records and a replay does.
+*/
+
+#include "AdaptiveStep.h"
+#include "Profiler.h"
+
+#include <cmath>
+#include <cstring>
+
+//The most the step length changes by from one step to the next, up or down
+#define STEP_MAX_GROWTH 2.0f
+
+//The fraction of the ideal step length actually taken, to keep the next step from failing
+#define STEP_SAFETY 0.9f
+
+///
+//Copies the positions, velocities and forces of one particle store into another of the same size
+static void CopyParticles(const ParticleStore &source, ParticleStore &dest)
+{
+	size_t bytes = sizeof(float) * source.count;
+	memcpy(dest.x, source.x, bytes);
+	memcpy(dest.y, source.y, bytes);
+	memcpy(dest.vx, source.vx, bytes);
+	memcpy(dest.vy, source.vy, bytes);
+	memcpy(dest.fx, source.fx, bytes);
+	memcpy(dest.fy, source.fy, bytes);
+}
+
+AdaptiveStepper::AdaptiveStepper()
+{
+	Configure(0.001f, 0.05f, 1e-4f, 0.012f);
+	lastError = 0.0f;
+	rejections = 0;
+}
+
+AdaptiveStepper::~AdaptiveStepper()
+{
+	Release();
+}
+
+void AdaptiveStepper::Configure(float shortest, float longest, float error, float first)
+{
+	minStep = shortest;
+	maxStep = longest;
+	tolerance = error;
+	step = first < minStep ? minStep : (first > maxStep ? maxStep : first);
+}
+
+float AdaptiveStepper::Step(World &world, SoftBodySolver &solver, float limit, float externalX, float externalY, StepLogWriter* log)
+{
+	PROFILE_ZONE("Adaptive step");
+	ParticleStore &p = world.particles;
+
+	if (start.count != p.count)
+	{
+		start.Allocate(p.count);
+		whole.Allocate(p.count);
+	}
+	while (sleep.size() < world.bodies.size()) sleep.push_back(new SleepSystem());
+
+	for (;;)
+	{
+		float h = step < limit ? step : limit;
+
+		CopyParticles(p, start);
+		for (size_t i = 0; i < world.bodies.size(); ++i) sleep[i]->CopyState(world.bodies[i]->sleep);
+
+		world.Step(solver, h, externalX, externalY);
+		CopyParticles(p, whole);
+
+		CopyParticles(start, p);
+		for (size_t i = 0; i < world.bodies.size(); ++i) world.bodies[i]->sleep.CopyState(*sleep[i]);
+
+		float half = 0.5f * h;
+		world.Step(solver, half, externalX, externalY);
+		world.Step(solver, half, externalX, externalY);
+
+		//Only the bodies are measured; the padding between them never moves
+		float error = 0.0f;
+		float scale = STEP_MAX_GROWTH;
+		for (size_t b = 0; b < world.bodies.size(); ++b)
+		{
+			const WorldBody &body = *world.bodies[b];
+			unsigned int first = body.firstParticle;
+			unsigned int end = first + body.view.numParticles;
+
+			float bodyError = 0.0f;
+			bool finite = true;
+			for (unsigned int i = first; i < end; ++i)
+			{
+				float dx = fabsf(p.x[i] - whole.x[i]);
+				float dy = fabsf(p.y[i] - whole.y[i]);
+				bodyError = dx > bodyError ? dx : bodyError;
+				bodyError = dy > bodyError ? dy : bodyError;
+				finite = finite && dx < INFINITY && dy < INFINITY;
+			}
+
+			//A step that blew up shrinks as far as it can
+			if (!finite) bodyError = INFINITY;
+			error = bodyError > error ? bodyError : error;
+
+			IntegratorType integrator = body.integrator < 0 ? solver.integrator : (IntegratorType)body.integrator;
+			float bodyScale = STEP_MAX_GROWTH;
+			if (bodyError > 0.0f)
+			{
+				float ratio = tolerance / bodyError;
+				bodyScale = STEP_SAFETY * (integrator == INTEGRATOR_EXPLICIT_EULER ? cbrtf(ratio) : sqrtf(ratio));
+			}
+			scale = bodyScale < scale ? bodyScale : scale;
+		}
+		if (scale > STEP_MAX_GROWTH) scale = STEP_MAX_GROWTH;
+		if (scale < 1.0f / STEP_MAX_GROWTH) scale = 1.0f / STEP_MAX_GROWTH;
+
+		//A step cut short by the limit says nothing against the length it was cut from
+		float next = h * scale;
+		if (h < step && error <= tolerance && next < step) next = step;
+		next = next < minStep ? minStep : (next > maxStep ? maxStep : next);
+
+		if (error <= tolerance || h <= minStep)
+		{
+			step = next;
+			lastError = error;
+			if (log != nullptr)
+			{
+				log->Append(half, externalX, externalY);
+				log->Append(half, externalX, externalY);
+			}
+			return h;
+		}
+
+		//Try again, shorter, from where the step started
+		++rejections;
+		step = next;
+		CopyParticles(start, p);
+		for (size_t i = 0; i < world.bodies.size(); ++i) world.bodies[i]->sleep.CopyState(*sleep[i]);
+	}
+}
+
+void AdaptiveStepper::Release()
+{
+	start.Release();
+	whole.Release();
+	for (size_t i = 0; i < sleep.size(); ++i)
+	{
+		delete sleep[i];
+	}
+	sleep.clear();
+}
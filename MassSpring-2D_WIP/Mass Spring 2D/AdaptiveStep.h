@@ -0,0 +1,69 @@
+#ifndef _ADAPTIVE_STEP_H
+#define _ADAPTIVE_STEP_H
+
+#include "World.h"
+#include "StepLog.h"
+
+#include <vector>
+
+//Chooses the length of each step of a world from an estimate of the integration error.
+//
+//Each step is taken twice from the same state, once whole and once as two halves, and the largest
+//difference between the resulting positions estimates the error of the step. If it is within the
+//tolerance the two half steps are kept, otherwise the state is put back and the step retried shorter.
+//Either way the next step is scaled towards the length that would have just met the tolerance, so the
+//steps grow while the lattices are calm and shrink as soon as something disturbs them.
+//
+//A step costs three world steps, so it pays off once the steps the tolerance allows are more than three
+//times the fixed step that would otherwise be needed for the worst moments of a run.
+struct AdaptiveStepper
+{
+	float minStep;				//The shortest step; taken regardless of the error
+	float maxStep;				//The longest step
+	float tolerance;			//The largest position error accepted per step
+	float step;					//The length the next step is tried with
+
+	float lastError;			//The estimated error of the last step kept
+	unsigned int rejections;	//The number of step attempts thrown away so far
+
+	//The state at the start of the step being tried, and the positions the whole step reached
+	struct ParticleStore start;
+	struct ParticleStore whole;
+	std::vector<SleepSystem*> sleep;
+
+	///
+	//Default constructor, steps between 0.001 and 0.05 with a tolerance of 1e-4
+	AdaptiveStepper();
+	~AdaptiveStepper();
+
+	///
+	//Sets the limits of the step length
+	//
+	//Parameters:
+	//	shortest: The shortest step
+	//	longest: The longest step
+	//	error: The largest position error accepted per step
+	//	first: The length to try the first step with
+	void Configure(float shortest, float longest, float error, float first);
+
+	///
+	//Advances a world by one step of a length chosen to keep the error within the tolerance
+	//
+	//Parameters:
+	//	world: The world to step
+	//	solver: The solver to step it with
+	//	limit: The longest the step may be, such as the time left to simulate
+	//	externalX: X component of the external force applied to each body's bottom row
+	//	externalY: Y component of the external force applied to each body's bottom row
+	//	log: Where to append the two half steps kept, or nullptr
+	//
+	//Returns:
+	//	The length of the step taken
+	float Step(World &world, SoftBodySolver &solver, float limit, float externalX, float externalY, StepLogWriter* log);
+
+	///
+	//Frees the copies of the state
+	void Release();
+};
+
+#endif //_ADAPTIVE_STEP_H
@@ -0,0 +1,53 @@
+#ifndef _ALIGNED_MEMORY_H
+#define _ALIGNED_MEMORY_H
+
+#include <cstdlib>
+#include <cstring>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+//Every solver array is aligned to a full cache line so that no two arrays share one
+//and so that vector loads never straddle a line boundary.
+#define CACHE_LINE_SIZE 64
+
+///
+//Allocates a block of memory aligned to a cache line
+//
+//Parameters:
+//	size: The number of bytes to allocate
+//
+//Returns:
+//	A pointer to the zeroed block, or nullptr if size is 0
+inline void* AlignedAlloc(size_t size)
+{
+	if (size == 0) return nullptr;
+
+	//Round up to a whole number of cache lines so the tail of an array is never shared
+	size = (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+
+#ifdef _MSC_VER
+	void* memory = _aligned_malloc(size, CACHE_LINE_SIZE);
+#else
+	void* memory = nullptr;
+	if (posix_memalign(&memory, CACHE_LINE_SIZE, size) != 0) memory = nullptr;
+#endif
+	if (memory != nullptr) memset(memory, 0, size);
+	return memory;
+}
+
+///
+//Frees a block allocated with AlignedAlloc
+//
+//Parameters:
+//	memory: The block to free (may be nullptr)
+inline void AlignedFree(void* memory)
+{
+#ifdef _MSC_VER
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+#endif //_ALIGNED_MEMORY_H
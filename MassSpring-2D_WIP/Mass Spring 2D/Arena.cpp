@@ -0,0 +1,109 @@
+/*
+Arenas
+
+Huge pages cut the TLB misses of streaming through arrays of millions of particles. They are asked
+for with MAP_HUGETLB on Linux, which needs pages set aside by the administrator, and failing that
+with madvise(MADV_HUGEPAGE) on an ordinary mapping for transparent huge pages. Windows needs
+MEM_LARGE_PAGES and the "Lock pages in memory" privilege. Where none of these work the block is an
+ordinary AlignedAlloc one, so asking for huge pages never stops a scene from loading.
+*/
+
+#include "Arena_Struct.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+//The huge page size blocks are rounded up to where the OS does not say
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+///
+//Maps a block of huge pages straight from the OS
+//
+//Parameters:
+//	size: The bytes needed, rounded up to a whole number of huge pages on return
+//
+//Returns:
+//	The zeroed block, or nullptr if the OS refused
+static void* MapHugePages(size_t &size)
+{
+#ifdef _WIN32
+	size_t page = GetLargePageMinimum();
+	if (page == 0) return nullptr;
+	size_t rounded = (size + page - 1) / page * page;
+
+	void* memory = VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+	if (memory != nullptr) size = rounded;
+	return memory;
+#else
+	size_t rounded = (size + ARENA_HUGE_PAGE_SIZE - 1) / ARENA_HUGE_PAGE_SIZE * ARENA_HUGE_PAGE_SIZE;
+	void* memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	memory = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+#ifdef MADV_HUGEPAGE
+	if (memory == MAP_FAILED)
+	{
+		memory = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory != MAP_FAILED && madvise(memory, rounded, MADV_HUGEPAGE) != 0)
+		{
+			munmap(memory, rounded);
+			memory = MAP_FAILED;
+		}
+	}
+#endif
+	if (memory == MAP_FAILED) return nullptr;
+
+	size = rounded;
+	return memory;
+#endif
+}
+
+bool Arena::Reserve(size_t size, bool huge)
+{
+	used = 0;
+	if (size <= capacity && huge == hugeRequested) return true;
+
+	Release();
+	size = Footprint(size);
+	if (size == 0) return true;
+
+	if (huge)
+	{
+		data = (char*)MapHugePages(size);
+		hugePages = data != nullptr;
+	}
+	if (data == nullptr) data = (char*)AlignedAlloc(size);
+	if (data == nullptr) return false;
+
+	capacity = size;
+	hugeRequested = huge;
+	return true;
+}
+
+void Arena::Release()
+{
+	if (data != nullptr)
+	{
+		if (hugePages)
+		{
+#ifdef _WIN32
+			VirtualFree(data, 0, MEM_RELEASE);
+#else
+			munmap(data, capacity);
+#endif
+		}
+		else
+		{
+			AlignedFree(data);
+		}
+	}
+
+	data = nullptr;
+	capacity = used = 0;
+	hugeRequested = hugePages = false;
+}
@@ -0,0 +1,97 @@
+#ifndef _ARENA_STRUCT_H
+#define _ARENA_STRUCT_H
+
+#include "AlignedMemory.h"
+
+//The smallest page size, which arrays in an arena are kept from being a multiple of
+#define ARENA_PAGE_SIZE 4096
+
+//One block of memory handed out front to back.
+//Every array taken from it starts on a cache line and is zeroed, as from AlignedAlloc, but nothing
+//taken is freed on its own: Reset gives the whole block back at once, and a later Reserve that fits
+//reuses it, so rebuilding a scene touches neither the heap nor the OS.
+struct Arena
+{
+	char* data;			//The start of the block, cache line aligned, or nullptr if none is reserved
+	size_t capacity;	//The size of the block in bytes
+	size_t used;		//The bytes handed out since the last Reset
+	bool hugeRequested;	//Whether the block was reserved asking for huge pages
+	bool hugePages;		//Whether the OS gave huge pages, mapped straight from it rather than through AlignedAlloc
+
+	///
+	//Default constructor, reserves nothing
+	Arena()
+	{
+		data = nullptr;
+		capacity = used = 0;
+		hugeRequested = hugePages = false;
+	}
+
+	~Arena()
+	{
+		Release();
+	}
+
+	///
+	//Returns the bytes Take uses for an array: rounded up to whole cache lines, and one line more if
+	//that is a whole number of pages. Back to back arrays of a power of two size would otherwise start
+	//a power of two apart, and in physically contiguous huge pages the same element of every array
+	//would compete for the same cache set.
+	//
+	//Parameters:
+	//	size: The size of the array in bytes
+	static size_t Footprint(size_t size)
+	{
+		size = (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+		if (size != 0 && size % ARENA_PAGE_SIZE == 0) size += CACHE_LINE_SIZE;
+		return size;
+	}
+
+	///
+	//Makes room for a number of bytes and resets the arena. The block is kept if it is big enough and
+	//was reserved with the same page setting, otherwise it is replaced.
+	//
+	//Parameters:
+	//	size: The bytes needed, the sum of the Footprint of every array to be taken
+	//	huge: Whether to ask for huge pages. Falls back to ordinary pages if the OS refuses.
+	//
+	//Returns:
+	//	False if the memory could not be allocated
+	bool Reserve(size_t size, bool huge);
+
+	///
+	//Hands out the next array of the block
+	//
+	//Parameters:
+	//	size: The size of the array in bytes
+	//
+	//Returns:
+	//	The zeroed array, or nullptr if size is 0 or the block has no room for it
+	void* Take(size_t size)
+	{
+		size = Footprint(size);
+		if (size == 0 || size > capacity - used) return nullptr;
+
+		void* memory = data + used;
+		used += size;
+		memset(memory, 0, size);
+		return memory;
+	}
+
+	///
+	//Gives back every array taken, without freeing the block. Arrays taken before become invalid.
+	void Reset()
+	{
+		used = 0;
+	}
+
+	///
+	//Frees the block
+	void Release();
+
+private:
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+};
+
+#endif //_ARENA_STRUCT_H
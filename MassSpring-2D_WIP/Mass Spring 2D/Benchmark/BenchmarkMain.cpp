@@ -0,0 +1,215 @@
+/*
+Title: Mass Spring Softbody (2D) - Benchmark
+File Name: BenchmarkMain.cpp
+
+Description:
+Measures the per-step stages of the viewer's hot path separately:
+	force:       SoftBodySolver::SolveSprings (spring kernel and scatter)
+	integrate:   SoftBodySolver::Integrate (external force and IntegrateLinear)
+	vertexCopy:  WriteVertexPositions into an x, y array, as update() does for Mesh positions
+	collide:     SolveSelfCollisions with a radius of 0.4 of the lattice spacing (hash, sort and contacts)
+over square lattices from 10x10 up to 2048x2048, and writes the results as JSON.
+
+Each stage is repeated until it has run for at least the minimum time, and the mean is reported.
+Throughput is reported against a simple model of the bytes each stage must move:
+	force:       per spring a, b, restLength, stiffness read and forceX, forceY written then read,
+	             per particle x, y, vx, vy read and fx, fy read and written
+	integrate:   per particle x, y, vx, vy, fx, fy read and written and invMass read
+	vertexCopy:  per particle x, y read and written
+	collide:     per particle x, y read twice, slot written and read twice, sorted index, x, y, vx, vy,
+	             invMass written and read, corrections written and read, x, y, vx, vy read and written
+
+Usage:
+	MassSpringBenchmark [options]
+		--max-size N      Largest lattice side to measure (default 2048)
+		--min-time S      Minimum time to spend on each stage and size (default 0.25)
+		--threads N       Solver threads, 0 for one per hardware thread (default 0)
+		--kernel NAME     Widest spring kernel to use: scalar, sse42 or avx2 (default avx2)
+		--out FILE        Write the JSON to FILE instead of stdout
+*/
+
+#include "../SoftBodySolver.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+//The result of timing one stage
+struct StageTiming
+{
+	double nsPerCall;	//Mean wall time of one call
+	int calls;			//The number of calls measured
+};
+
+///
+//Calls a stage repeatedly until at least minTime seconds have passed
+//
+//Parameters:
+//	minTime: The minimum time to spend, in seconds
+//	stage: The stage to time
+StageTiming timeStage(double minTime, const std::function<void()> &stage)
+{
+	//Warm up caches and wake the workers
+	stage();
+
+	StageTiming timing;
+	timing.calls = 0;
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	double elapsed = 0.0;
+	do
+	{
+		stage();
+		++timing.calls;
+		elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	} while (elapsed < minTime || timing.calls < 3);
+
+	timing.nsPerCall = elapsed * 1e9 / timing.calls;
+	return timing;
+}
+
+///
+//Writes one stage's results as a JSON object
+//
+//Parameters:
+//	out: The file to write to
+//	name: The name of the stage
+//	timing: The stage's timing
+//	items: The number of items (springs or nodes) the stage processes
+//	itemName: The name of the per-item figure
+//	bytes: The number of bytes the stage moves per call
+//	last: Whether this is the last stage of the object
+void writeStage(FILE* out, const char* name, const StageTiming &timing, double items, const char* itemName, double bytes, bool last)
+{
+	fprintf(out, "        \"%s\": { \"ns\": %.1f, \"calls\": %d, \"%s\": %.4f, \"gb_per_s\": %.3f }%s\n",
+		name, timing.nsPerCall, timing.calls, itemName, timing.nsPerCall / items, bytes / timing.nsPerCall, last ? "" : ",");
+}
+
+int main(int argc, char** argv)
+{
+	int maxSize = 2048;
+	double minTime = 0.25;
+	int threads = 0;
+	SpringKernelISA maxISA = SPRING_KERNEL_AVX2;
+	const char* outPath = nullptr;
+
+	//Parse the options
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		int remaining = argc - i - 1;
+
+		if (strcmp(arg, "--max-size") == 0 && remaining >= 1)
+		{
+			maxSize = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--min-time") == 0 && remaining >= 1)
+		{
+			minTime = atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--threads") == 0 && remaining >= 1)
+		{
+			threads = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--kernel") == 0 && remaining >= 1)
+		{
+			const char* name = argv[++i];
+			if (strcmp(name, "scalar") == 0) maxISA = SPRING_KERNEL_SCALAR;
+			else if (strcmp(name, "sse42") == 0) maxISA = SPRING_KERNEL_SSE42;
+			else if (strcmp(name, "avx2") == 0) maxISA = SPRING_KERNEL_AVX2;
+			else
+			{
+				fprintf(stderr, "Unknown kernel: %s\n", name);
+				return 1;
+			}
+		}
+		else if (strcmp(arg, "--out") == 0 && remaining >= 1)
+		{
+			outPath = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "Usage: MassSpringBenchmark [--max-size N] [--min-time S] [--threads N]\n");
+			fprintf(stderr, "                           [--kernel scalar|sse42|avx2] [--out FILE]\n");
+			return strcmp(arg, "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	FILE* out = stdout;
+	if (outPath != nullptr)
+	{
+		out = fopen(outPath, "w");
+		if (out == nullptr)
+		{
+			fprintf(stderr, "Can't write file: %s\n", outPath);
+			return 1;
+		}
+	}
+
+	SoftBodySolver solver(threads, maxISA);
+
+	const int sizes[] = { 10, 32, 64, 128, 256, 512, 1024, 2048 };
+	const int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"kernel\": \"%s\",\n", GetSpringKernelName(solver.isa));
+	fprintf(out, "  \"threads\": %d,\n", solver.pool->numThreads);
+	fprintf(out, "  \"results\": [\n");
+
+	bool first = true;
+	for (int s = 0; s < numSizes && sizes[s] <= maxSize; ++s)
+	{
+		int size = sizes[s];
+		fprintf(stderr, "Measuring %dx%d\n", size, size);
+
+		SoftBody body(1.0f, 1.0f, size, size, 25.0f, 0.5f);
+		std::vector<float> positions(2 * body.numParticles, 0.0f);
+
+		//Perturb the lattice so the springs are not all at rest
+		for (int i = 0; i < 10; ++i)
+		{
+			solver.Step(body, 0.012f, 2.0f, 0.0f);
+		}
+
+		double springs = body.springs.count;
+		double nodes = body.numParticles;
+
+		//Collisions first, the integrate stage alone lets the lattice drift apart
+		float radius = 0.4f * (body.restWidth < body.restHeight ? body.restWidth : body.restHeight);
+		StageTiming collide = timeStage(minTime, [&]
+		{
+			SolveSelfCollisions(body.particles, solver.collision, *solver.pool, solver.pool->numThreads, radius);
+		});
+
+		StageTiming force = timeStage(minTime, [&] { solver.SolveSprings(body); });
+		StageTiming integrate = timeStage(minTime, [&] { solver.Integrate(body, 0.012f, 2.0f, 0.0f); });
+		StageTiming copy = timeStage(minTime, [&]
+		{
+			WriteVertexPositions(body.particles, 0, body.numParticles, positions.data(), 2);
+		});
+
+		double forceBytes = springs * 4.0 * (4 + 2 * 2) + nodes * 4.0 * (4 + 2 * 2);
+		double integrateBytes = nodes * 4.0 * (6 * 2 + 1);
+		double copyBytes = nodes * 4.0 * (2 * 2);
+		double collideBytes = nodes * 4.0 * (2 * 2 + 3 + 6 * 2 + 4 * 2 + 4 * 2);
+
+		fprintf(out, "%s    {\n", first ? "" : ",\n");
+		fprintf(out, "      \"width\": %d, \"height\": %d, \"particles\": %u, \"springs\": %u,\n", size, size, body.numParticles, body.springs.count);
+		fprintf(out, "      \"stages\": {\n");
+		writeStage(out, "force", force, springs, "ns_per_spring", forceBytes, false);
+		writeStage(out, "integrate", integrate, nodes, "ns_per_node", integrateBytes, false);
+		writeStage(out, "vertexCopy", copy, nodes, "ns_per_node", copyBytes, false);
+		writeStage(out, "collide", collide, nodes, "ns_per_node", collideBytes, true);
+		fprintf(out, "      }\n");
+		fprintf(out, "    }");
+		first = false;
+	}
+
+	fprintf(out, "\n  ]\n}\n");
+
+	if (out != stdout) fclose(out);
+	return 0;
+}
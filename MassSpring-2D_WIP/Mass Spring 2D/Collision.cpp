@@ -0,0 +1,230 @@
+/*
+Self-collision
+
+Treats every particle as a disc of the given radius and separates overlapping discs after the
+integrator has stepped. Each step:
+	1. Find the particles' bounding box, lay a uniform grid over it and hash every particle's cell,
+	   see CollisionSystem
+	2. Counting sort the particles by slot: count each slot, prefix sum the counts, then scatter the
+	   particle indices and a copy of their positions, velocities and inverse masses in slot order
+	3. For each particle, look through the 3x3 cells around it and accumulate a correction pushing it
+	   out of every disc it overlaps and cancelling the velocity it approaches that disc with
+	4. Apply the corrections
+
+Every pass is linear in the number of particles, and all but the count, prefix sum and scatter of the
+sort are split across the worker threads. Step 3 only reads the sorted copies and writes the
+correction of its own particle, and every pair is resolved from both sides, so the result does not
+depend on the number of threads.
+
+The corrections are averaged over a particle's contacts (a Jacobi iteration), so a particle pressed
+from several sides is not pushed out several times over. The radius should stay below half the
+shortest rest length, or neighbours at rest would already be touching.
+*/
+
+#include "SoftBodySolver.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+unsigned int SolveSelfCollisions(ParticleStore &particles, CollisionSystem &system, ThreadPool &pool, int tasks, float radius)
+{
+	ParticleStore &p = particles;
+	CollisionSystem &sys = system;
+	unsigned int count = p.count;
+
+	sys.Resize(count);
+	if (count < 2 || radius <= 0.0f)
+	{
+		sys.contacts = 0;
+		return 0;
+	}
+
+	float contact = 2.0f * radius;
+	float contact2 = contact * contact;
+
+	//Every task needs a particle to start its part of the bounding box from
+	if (tasks > (int)count) tasks = (int)count;
+
+	//Find the bounding box
+	std::vector<float> bounds(4 * tasks);
+	pool.Run(tasks, [&](int task)
+	{
+		int begin, end;
+		ThreadPool::Partition(count, tasks, task, begin, end);
+		float minX = p.x[begin], minY = p.y[begin];
+		float maxX = minX, maxY = minY;
+		for (int i = begin; i < end; ++i)
+		{
+			minX = p.x[i] < minX ? p.x[i] : minX;
+			maxX = p.x[i] > maxX ? p.x[i] : maxX;
+			minY = p.y[i] < minY ? p.y[i] : minY;
+			maxY = p.y[i] > maxY ? p.y[i] : maxY;
+		}
+		bounds[4 * task + 0] = minX;
+		bounds[4 * task + 1] = minY;
+		bounds[4 * task + 2] = maxX;
+		bounds[4 * task + 3] = maxY;
+	});
+
+	float minX = bounds[0], minY = bounds[1], maxX = bounds[2], maxY = bounds[3];
+	for (int task = 1; task < tasks; ++task)
+	{
+		minX = bounds[4 * task + 0] < minX ? bounds[4 * task + 0] : minX;
+		minY = bounds[4 * task + 1] < minY ? bounds[4 * task + 1] : minY;
+		maxX = bounds[4 * task + 2] > maxX ? bounds[4 * task + 2] : maxX;
+		maxY = bounds[4 * task + 3] > maxY ? bounds[4 * task + 3] : maxY;
+	}
+
+	//A diverged simulation has no meaningful grid
+	if (!std::isfinite(minX) || !std::isfinite(minY) || !std::isfinite(maxX) || !std::isfinite(maxY))
+	{
+		sys.contacts = 0;
+		return 0;
+	}
+	sys.Fit(minX, minY, maxX, contact);
+
+	//Hash every particle's cell
+	pool.Run(tasks, [&](int task)
+	{
+		int begin, end;
+		ThreadPool::Partition(count, tasks, task, begin, end);
+		for (int i = begin; i < end; ++i)
+		{
+			sys.slot[i] = sys.Hash(sys.Column(p.x[i]), sys.Row(p.y[i]));
+		}
+	});
+
+	//Counting sort by slot: count, then turn the counts into the end of each slot's range
+	unsigned int* start = sys.slotStart;
+	unsigned int tableSize = sys.tableSize;
+	memset(start, 0, sizeof(unsigned int) * (tableSize + 1));
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		++start[sys.slot[i]];
+	}
+	for (unsigned int s = 1; s < tableSize; ++s)
+	{
+		start[s] += start[s - 1];
+	}
+	start[tableSize] = count;
+
+	//Scatter back to front, decrementing each slot's end until it is the slot's start.
+	//Going backwards keeps the particles of a slot in index order.
+	for (unsigned int i = count; i-- > 0;)
+	{
+		unsigned int k = --start[sys.slot[i]];
+		sys.sorted[k] = i;
+		sys.sortedX[k] = p.x[i];
+		sys.sortedY[k] = p.y[i];
+		sys.sortedVX[k] = p.vx[i];
+		sys.sortedVY[k] = p.vy[i];
+		sys.sortedInvMass[k] = p.invMass[i];
+	}
+
+	//Accumulate each sorted particle's correction against the discs around it
+	std::vector<unsigned int> partial(tasks);
+	pool.Run(tasks, [&](int task)
+	{
+		int begin, end;
+		ThreadPool::Partition(count, tasks, task, begin, end);
+		unsigned int found = 0;
+
+		for (int k = begin; k < end; ++k)
+		{
+			float x = sys.sortedX[k];
+			float y = sys.sortedY[k];
+			float vx = sys.sortedVX[k];
+			float vy = sys.sortedVY[k];
+			float w = sys.sortedInvMass[k];
+			unsigned int column = sys.Column(x);
+			unsigned int row = sys.Row(y);
+
+			float cx = 0.0f, cy = 0.0f, cvx = 0.0f, cvy = 0.0f;
+			unsigned int touching = 0;
+
+			//The 3x3 block of cells around the particle, each in its own slot.
+			//Rows and columns left of or below the grid wrap around and find whatever shares their slot.
+			for (unsigned int r = row - 1; r != row + 2; ++r)
+			{
+				for (unsigned int c = column - 1; c != column + 2; ++c)
+				{
+					unsigned int s = sys.Hash(c, r);
+					unsigned int last = start[s + 1];
+					for (unsigned int o = start[s]; o < last; ++o)
+					{
+						if (o == (unsigned int)k) continue;
+
+						float nx = x - sys.sortedX[o];
+						float ny = y - sys.sortedY[o];
+						float dist2 = nx * nx + ny * ny;
+						if (dist2 >= contact2) continue;
+
+						float wSum = w + sys.sortedInvMass[o];
+						if (wSum <= 0.0f || dist2 <= 0.0f) continue;
+
+						//This particle's share of the separation, by inverse mass
+						float dist = sqrtf(dist2);
+						float share = w / wSum;
+						nx /= dist;
+						ny /= dist;
+
+						float push = share * (contact - dist);
+						cx += push * nx;
+						cy += push * ny;
+
+						//Cancel its share of the approaching relative velocity
+						float vn = (vx - sys.sortedVX[o]) * nx + (vy - sys.sortedVY[o]) * ny;
+						if (vn < 0.0f)
+						{
+							cvx -= share * vn * nx;
+							cvy -= share * vn * ny;
+						}
+
+						++touching;
+					}
+				}
+			}
+
+			if (touching > 1)
+			{
+				float scale = 1.0f / touching;
+				cx *= scale;
+				cy *= scale;
+				cvx *= scale;
+				cvy *= scale;
+			}
+			sys.dx[k] = cx;
+			sys.dy[k] = cy;
+			sys.dvx[k] = cvx;
+			sys.dvy[k] = cvy;
+			found += touching;
+		}
+
+		partial[task] = found;
+	});
+
+	//Apply the corrections, each particle appears once in the sorted order
+	pool.Run(tasks, [&](int task)
+	{
+		int begin, end;
+		ThreadPool::Partition(count, tasks, task, begin, end);
+		for (int k = begin; k < end; ++k)
+		{
+			unsigned int i = sys.sorted[k];
+			p.x[i] += sys.dx[k];
+			p.y[i] += sys.dy[k];
+			p.vx[i] += sys.dvx[k];
+			p.vy[i] += sys.dvy[k];
+		}
+	});
+
+	//Every contact was counted from both of its particles
+	unsigned int found = 0;
+	for (int task = 0; task < tasks; ++task)
+	{
+		found += partial[task];
+	}
+	sys.contacts = found / 2;
+	return sys.contacts;
+}
@@ -0,0 +1,164 @@
+#ifndef _COLLISIONSYSTEM_STRUCT_H
+#define _COLLISIONSYSTEM_STRUCT_H
+
+#include "AlignedMemory.h"
+
+//The farthest cell from the grid's corner that is told apart from its neighbours
+#define COLLISION_MAX_CELL (1u << 30)
+
+//Working storage for particle self-collision.
+//Space is divided into a uniform grid of square cells one contact distance wide, starting at the
+//corner of the particles' bounding box, and the cells are hashed into a table with at least twice as
+//many slots as there are particles, so the grid needs no bounds and the memory does not depend on how
+//far the particles spread. The hash numbers the cells row by row, one row pitch apart, wrapped to the
+//table size: neighbouring cells of a row land in neighbouring slots, and the 3x3 block around a cell
+//never lands on the same slot twice. Cells far apart may share a slot, which only costs a few more
+//distance checks.
+//The table is rebuilt every step with a counting sort: the particles are bucketed by slot into one flat
+//array, and their positions and velocities are copied alongside in the same order, so walking the
+//particles in slot order streams through memory rather than hopping around it.
+struct CollisionSystem
+{
+	unsigned int numParticles;	//The number of particles the arrays have room for
+	unsigned int tableSize;		//The number of hash table slots, a power of two
+
+	float originX;				//The corner of the grid's first cell
+	float originY;
+	float invCellSize;			//The number of cells per unit length
+	unsigned int rowPitch;		//The distance between the slots of vertically neighbouring cells
+
+	unsigned int* slot;			//Per particle: the table slot of its cell
+	unsigned int* slotStart;	//Per slot: slot s holds sorted[slotStart[s]] ... sorted[slotStart[s + 1] - 1]
+
+	unsigned int* sorted;		//Particle indices sorted by slot
+	float* sortedX;				//Per sorted particle: a copy of its position, velocity and inverse mass
+	float* sortedY;
+	float* sortedVX;
+	float* sortedVY;
+	float* sortedInvMass;
+
+	float* dx;					//Per sorted particle: the position and velocity correction of the step
+	float* dy;
+	float* dvx;
+	float* dvy;
+
+	unsigned int contacts;		//The number of colliding pairs found by the last step
+
+	///
+	//Default constructor, creates an empty system
+	CollisionSystem()
+	{
+		numParticles = tableSize = contacts = 0;
+		originX = originY = invCellSize = 0.0f;
+		rowPitch = 0;
+		slot = slotStart = sorted = nullptr;
+		sortedX = sortedY = sortedVX = sortedVY = sortedInvMass = nullptr;
+		dx = dy = dvx = dvy = nullptr;
+	}
+
+	~CollisionSystem()
+	{
+		Release();
+	}
+
+	///
+	//Makes room for the given number of particles. Does nothing if the size has not changed.
+	//
+	//Parameters:
+	//	particles: The number of particles to collide
+	void Resize(unsigned int particles)
+	{
+		if (particles == numParticles) return;
+
+		Release();
+		numParticles = particles;
+
+		//At least 16 slots so that three rows of three cells always fit apart
+		tableSize = 16;
+		while (tableSize < 2 * numParticles) tableSize <<= 1;
+
+		slot = (unsigned int*)AlignedAlloc(sizeof(unsigned int) * numParticles);
+		slotStart = (unsigned int*)AlignedAlloc(sizeof(unsigned int) * (tableSize + 1));
+		sorted = (unsigned int*)AlignedAlloc(sizeof(unsigned int) * numParticles);
+		sortedX = (float*)AlignedAlloc(sizeof(float) * numParticles);
+		sortedY = (float*)AlignedAlloc(sizeof(float) * numParticles);
+		sortedVX = (float*)AlignedAlloc(sizeof(float) * numParticles);
+		sortedVY = (float*)AlignedAlloc(sizeof(float) * numParticles);
+		sortedInvMass = (float*)AlignedAlloc(sizeof(float) * numParticles);
+		dx = (float*)AlignedAlloc(sizeof(float) * numParticles);
+		dy = (float*)AlignedAlloc(sizeof(float) * numParticles);
+		dvx = (float*)AlignedAlloc(sizeof(float) * numParticles);
+		dvy = (float*)AlignedAlloc(sizeof(float) * numParticles);
+	}
+
+	///
+	//Lays the grid over a bounding box
+	//
+	//Parameters:
+	//	minX, minY, maxX: The bounding box of the particles
+	//	contact: The cell size, the distance at which particles touch
+	void Fit(float minX, float minY, float maxX, float contact)
+	{
+		originX = minX;
+		originY = minY;
+		invCellSize = 1.0f / contact;
+
+		//One row of the box per pitch while it fits, so the rows of a compact body do not overlap
+		float columns = (maxX - minX) * invCellSize + 3.0f;
+		float maxPitch = (float)((tableSize - 3) / 3);
+		rowPitch = (unsigned int)(columns < maxPitch ? columns : maxPitch);
+	}
+
+	///
+	//Returns the column of the cell containing an x coordinate, which must not be left of the grid
+	unsigned int Column(float x) const
+	{
+		float column = (x - originX) * invCellSize;
+		return column < (float)COLLISION_MAX_CELL ? (unsigned int)column : COLLISION_MAX_CELL;
+	}
+
+	///
+	//Returns the row of the cell containing a y coordinate, which must not be below the grid
+	unsigned int Row(float y) const
+	{
+		float row = (y - originY) * invCellSize;
+		return row < (float)COLLISION_MAX_CELL ? (unsigned int)row : COLLISION_MAX_CELL;
+	}
+
+	///
+	//Returns the table slot of a cell
+	//
+	//Parameters:
+	//	column: The cell's column
+	//	row: The cell's row
+	unsigned int Hash(unsigned int column, unsigned int row) const
+	{
+		return (row * rowPitch + column) & (tableSize - 1);
+	}
+
+	///
+	//Frees all arrays
+	void Release()
+	{
+		AlignedFree(slot);
+		AlignedFree(slotStart);
+		AlignedFree(sorted);
+		AlignedFree(sortedX);
+		AlignedFree(sortedY);
+		AlignedFree(sortedVX);
+		AlignedFree(sortedVY);
+		AlignedFree(sortedInvMass);
+		AlignedFree(dx);
+		AlignedFree(dy);
+		AlignedFree(dvx);
+		AlignedFree(dvy);
+
+		slot = slotStart = sorted = nullptr;
+		sortedX = sortedY = sortedVX = sortedVY = sortedInvMass = nullptr;
+		dx = dy = dvx = dvy = nullptr;
+		numParticles = tableSize = contacts = 0;
+		rowPitch = 0;
+	}
+};
+
+#endif //_COLLISIONSYSTEM_STRUCT_H
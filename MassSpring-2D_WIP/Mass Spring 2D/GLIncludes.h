@@ -44,33 +44,33 @@ recalculates when the object's orientation changes, simply uncomment the rotate
 #include <vector>
 #include <string>
 #include <algorithm>
-#include "gl\glew.h"
-#include "glfw\glfw3.h"
-#include "glm\glm.hpp"
-#include "glm\gtc\matrix_transform.hpp"
-#include "glm\gtc\type_ptr.hpp"
-#include "glm\gtc\quaternion.hpp"
-#include "glm\gtx\quaternion.hpp"
+#include "GL/glew.h"
+#include "GLFW/glfw3.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
+#include "glm/gtc/quaternion.hpp"
+#include "glm/gtx/quaternion.hpp"
 
 // We create a VertexFormat struct, which defines how the data passed into the shader code wil be formatted
 struct VertexFormat
 {
 	glm::vec4 color;	// A vector4 for color has 4 floats: red, green, blue, and alpha
-	glm::vec3 position;	// A vector3 for position has 3 float: x, y, and z coordinates
+	glm::vec2 position;	// A vector2 for position has 2 floats: x and y coordinates, the z of a 2D mesh is always 0
 
 	// Default constructor
 	VertexFormat()
 	{
 		color = glm::vec4(0.0f);
-		position = glm::vec3(0.0f);
+		position = glm::vec2(0.0f);
 	}
 
 	// Constructor
-	VertexFormat(const glm::vec3 &pos, const glm::vec4 &iColor)
+	VertexFormat(const glm::vec2 &pos, const glm::vec4 &iColor)
 	{
 		position = pos;
 		color = iColor;
 	}
 };
 
-#endif _GL_INCLUDES_H
\ No newline at end of file
+#endif //_GL_INCLUDES_H
\ No newline at end of file
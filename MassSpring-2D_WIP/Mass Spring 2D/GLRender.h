@@ -32,4 +32,4 @@ glm::mat4 hue;
 // Reference to the window object being created by GLFW.
 GLFWwindow* window;
 
-
+#endif //_GL_RENDER_H
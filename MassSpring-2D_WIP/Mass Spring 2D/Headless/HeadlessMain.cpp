@@ -0,0 +1,630 @@
+/*
+Title: Mass Spring Softbody (2D) - Headless
+File Name: HeadlessMain.cpp
+
+Description:
+Runs the mass spring solver without a window or an OpenGL context, so batch simulations and
+throughput tests can be run on machines without a GPU. The lattices are read from a scene file,
+or a single lattice is built from the command line options; they are stepped a fixed number of
+times, and the timing is printed.
+
+Usage:
+	MassSpringHeadless [options]
+		--size W H        Number of point masses along X and Y (default 10 10)
+		--extent W H      Physical width and height of the lattice (default 1 1)
+		--steps N         Number of physics steps to run (default 1000)
+		--dt S            Physics timestep in seconds (default 0.012)
+		--adaptive MIN MAX  Let the step vary between MIN and MAX seconds to keep the error
+		                  within the tolerance, starting from --dt; --steps N then simulates
+		                  N times --dt seconds (default off)
+		--tolerance T     Adaptive: largest position error allowed per step (default 1e-4)
+		--step-log FILE   Log the length and external force of every step taken
+		--replay FILE     Take the steps of a step log instead of --steps, --dt, --adaptive
+		                  and --force
+		--coeff K         Spring coefficient (default 25)
+		--damp C          Dampening coefficient (default 0.5)
+		--force X Y       External force on the bottom row (default 2 0)
+		--threads N       Solver threads, 0 for one per hardware thread (default 0)
+		--deterministic   Produce the same bits on any number of threads
+		--huge-pages      Back the particles and springs with huge pages where the OS allows
+		--kernel NAME     Widest spring kernel to use: scalar, sse42 or avx2 (default avx2)
+		--integrator NAME explicit, implicit or xpbd (default explicit)
+		--cg-iterations N Implicit: most conjugate gradient iterations per step (default 50)
+		--cg-tolerance T  Implicit: relative residual to stop the solve at (default 1e-4)
+		--xpbd-iterations N  XPBD: constraint projections per step (default 10)
+		--collide R       Enable self-collision with particle radius R (default off)
+		--sleep E         Explicit: let tiles whose mean kinetic energy per unit mass stays
+		                  below E sleep (default off)
+		--sleep-steps N   Explicit: steps a tile must stay below it before sleeping (default 30)
+		--load FILE       Restore the lattice from a snapshot instead of building it from
+		                  --size, --extent, --coeff and --damp. It is stepped in place in the
+		                  mapped file, not copied, so --huge-pages has no effect on it
+		--save FILE       Write a snapshot of the lattice after the run
+		--record FILE     Record the positions of every step to a trajectory file
+		--quantum Q       Recording: position quantization step (default 1e-5)
+		--keyframe N      Recording: store a keyframe every N frames (default 100)
+		--scene FILE      Simulate the lattices and settings of a scene file (see Scene.h)
+		                  instead of --size, --extent, --dt, --adaptive, --tolerance, --coeff,
+		                  --damp, --threads, --deterministic, --huge-pages,
+		                  --integrator, --cg-iterations, --cg-tolerance, --xpbd-iterations
+		                  --collide, --sleep and --sleep-steps. --load, --save and --record need a single lattice.
+		--trace FILE      Write a Chrome trace of the solver passes (the last 65536 per thread)
+		--metrics FILE    Rewrite FILE with Prometheus text metrics every second and at the end
+		--metrics-port N  Serve the metrics at http://127.0.0.1:N/metrics during the run
+		--hash            Print a hash of the final positions and velocities
+		--expect-hash H   Exit with status 3 unless the final state hashes to H (hex), so a golden
+		                  hash from one run checks another; combine with --deterministic to
+		                  compare runs on different thread counts
+*/
+
+#include "../SoftBodySolver.h"
+#include "../Scene.h"
+#include "../World.h"
+#include "../SoftBodySnapshot.h"
+#include "../Trajectory.h"
+#include "../Profiler.h"
+#include "../MetricsExporter.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+///
+//Prints the usage text
+void printUsage()
+{
+	printf("Usage: MassSpringHeadless [--size W H] [--extent W H] [--steps N] [--dt S]\n");
+	printf("                          [--adaptive MIN MAX] [--tolerance T] [--step-log FILE] [--replay FILE]\n");
+	printf("                          [--coeff K] [--damp C] [--force X Y] [--threads N]\n");
+	printf("                          [--kernel scalar|sse42|avx2] [--integrator explicit|implicit|xpbd]\n");
+	printf("                          [--cg-iterations N] [--cg-tolerance T] [--xpbd-iterations N]\n");
+	printf("                          [--collide R] [--sleep E] [--sleep-steps N] [--load FILE] [--save FILE]\n");
+	printf("                          [--record FILE] [--quantum Q] [--keyframe N] [--scene FILE]\n");
+	printf("                          [--trace FILE] [--metrics FILE] [--metrics-port N]\n");
+	printf("                          [--deterministic] [--huge-pages] [--hash] [--expect-hash H]\n");
+}
+
+int main(int argc, char** argv)
+{
+	int sizeX = 10, sizeY = 10;
+	float extentX = 1.0f, extentY = 1.0f;
+	int steps = 1000;
+	float dt = 0.012f;
+	float minStep = 0.0f, maxStep = 0.0f;
+	float tolerance = 1e-4f;
+	const char* stepLogPath = nullptr;
+	const char* replayPath = nullptr;
+	float coeff = 25.0f;
+	float damp = 0.5f;
+	float forceX = 2.0f, forceY = 0.0f;
+	int threads = 0;
+	bool deterministic = false;
+	bool hugePages = false;
+	bool printHash = false;
+	const char* expectedHash = nullptr;
+	SpringKernelISA maxISA = SPRING_KERNEL_AVX2;
+	IntegratorType integrator = INTEGRATOR_EXPLICIT_EULER;
+	int cgIterations = 50;
+	float cgTolerance = 1e-4f;
+	int xpbdIterations = 10;
+	float collisionRadius = 0.0f;
+	float sleepThreshold = 0.0f;
+	int sleepSteps = 30;
+	const char* loadPath = nullptr;
+	const char* savePath = nullptr;
+	const char* recordPath = nullptr;
+	float quantum = 1e-5f;
+	int keyframeInterval = 100;
+	const char* scenePath = nullptr;
+	const char* tracePath = nullptr;
+	const char* metricsPath = nullptr;
+	int metricsPort = 0;
+
+	//Parse the options
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		int remaining = argc - i - 1;
+
+		if (strcmp(arg, "--size") == 0 && remaining >= 2)
+		{
+			sizeX = atoi(argv[++i]);
+			sizeY = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--extent") == 0 && remaining >= 2)
+		{
+			extentX = (float)atof(argv[++i]);
+			extentY = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--steps") == 0 && remaining >= 1)
+		{
+			steps = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--dt") == 0 && remaining >= 1)
+		{
+			dt = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--adaptive") == 0 && remaining >= 2)
+		{
+			minStep = (float)atof(argv[++i]);
+			maxStep = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--tolerance") == 0 && remaining >= 1)
+		{
+			tolerance = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--step-log") == 0 && remaining >= 1)
+		{
+			stepLogPath = argv[++i];
+		}
+		else if (strcmp(arg, "--replay") == 0 && remaining >= 1)
+		{
+			replayPath = argv[++i];
+		}
+		else if (strcmp(arg, "--coeff") == 0 && remaining >= 1)
+		{
+			coeff = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--damp") == 0 && remaining >= 1)
+		{
+			damp = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--force") == 0 && remaining >= 2)
+		{
+			forceX = (float)atof(argv[++i]);
+			forceY = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--threads") == 0 && remaining >= 1)
+		{
+			threads = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--deterministic") == 0)
+		{
+			deterministic = true;
+		}
+		else if (strcmp(arg, "--huge-pages") == 0)
+		{
+			hugePages = true;
+		}
+		else if (strcmp(arg, "--hash") == 0)
+		{
+			printHash = true;
+		}
+		else if (strcmp(arg, "--expect-hash") == 0 && remaining >= 1)
+		{
+			expectedHash = argv[++i];
+		}
+		else if (strcmp(arg, "--kernel") == 0 && remaining >= 1)
+		{
+			const char* name = argv[++i];
+			if (strcmp(name, "scalar") == 0) maxISA = SPRING_KERNEL_SCALAR;
+			else if (strcmp(name, "sse42") == 0) maxISA = SPRING_KERNEL_SSE42;
+			else if (strcmp(name, "avx2") == 0) maxISA = SPRING_KERNEL_AVX2;
+			else
+			{
+				printf("Unknown kernel: %s\n", name);
+				return 1;
+			}
+		}
+		else if (strcmp(arg, "--integrator") == 0 && remaining >= 1)
+		{
+			const char* name = argv[++i];
+			if (strcmp(name, "explicit") == 0) integrator = INTEGRATOR_EXPLICIT_EULER;
+			else if (strcmp(name, "implicit") == 0) integrator = INTEGRATOR_IMPLICIT_EULER;
+			else if (strcmp(name, "xpbd") == 0) integrator = INTEGRATOR_XPBD;
+			else
+			{
+				printf("Unknown integrator: %s\n", name);
+				return 1;
+			}
+		}
+		else if (strcmp(arg, "--cg-iterations") == 0 && remaining >= 1)
+		{
+			cgIterations = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--cg-tolerance") == 0 && remaining >= 1)
+		{
+			cgTolerance = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--xpbd-iterations") == 0 && remaining >= 1)
+		{
+			xpbdIterations = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--collide") == 0 && remaining >= 1)
+		{
+			collisionRadius = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--sleep") == 0 && remaining >= 1)
+		{
+			sleepThreshold = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--sleep-steps") == 0 && remaining >= 1)
+		{
+			sleepSteps = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--load") == 0 && remaining >= 1)
+		{
+			loadPath = argv[++i];
+		}
+		else if (strcmp(arg, "--save") == 0 && remaining >= 1)
+		{
+			savePath = argv[++i];
+		}
+		else if (strcmp(arg, "--record") == 0 && remaining >= 1)
+		{
+			recordPath = argv[++i];
+		}
+		else if (strcmp(arg, "--quantum") == 0 && remaining >= 1)
+		{
+			quantum = (float)atof(argv[++i]);
+		}
+		else if (strcmp(arg, "--keyframe") == 0 && remaining >= 1)
+		{
+			keyframeInterval = atoi(argv[++i]);
+		}
+		else if (strcmp(arg, "--scene") == 0 && remaining >= 1)
+		{
+			scenePath = argv[++i];
+		}
+		else if (strcmp(arg, "--trace") == 0 && remaining >= 1)
+		{
+			tracePath = argv[++i];
+		}
+		else if (strcmp(arg, "--metrics") == 0 && remaining >= 1)
+		{
+			metricsPath = argv[++i];
+		}
+		else if (strcmp(arg, "--metrics-port") == 0 && remaining >= 1)
+		{
+			metricsPort = atoi(argv[++i]);
+		}
+		else
+		{
+			printUsage();
+			return strcmp(arg, "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	if (sizeX < 2 || sizeY < 2 || steps < 0 || dt <= 0.0f || quantum <= 0.0f || keyframeInterval < 0 || sleepThreshold < 0.0f || sleepSteps < 1)
+	{
+		printf("The lattice must be at least 2x2, the step count and sleep threshold non-negative, the sleep steps\n");
+		printf("positive and the timestep and quantum positive\n");
+		return 1;
+	}
+	if (maxStep != 0.0f && (minStep <= 0.0f || maxStep < minStep || tolerance <= 0.0f))
+	{
+		printf("The adaptive step range must be positive and in order, and the tolerance positive\n");
+		return 1;
+	}
+
+	//The command line describes a scene of one lattice, unless a scene file is given
+	Scene scene;
+	if (scenePath != nullptr)
+	{
+		std::string error;
+		if (!LoadScene(scenePath, scene, error))
+		{
+			printf("%s\n", error.c_str());
+			return 1;
+		}
+		printf("Scene: %s\n", scenePath);
+	}
+	else
+	{
+		scene.physicsStep = dt;
+		scene.adaptiveMinStep = minStep;
+		scene.adaptiveMaxStep = maxStep;
+		scene.adaptiveTolerance = tolerance;
+		scene.threads = threads;
+		scene.deterministic = deterministic;
+		scene.hugePages = hugePages;
+		scene.integrator = integrator;
+		scene.cgMaxIterations = cgIterations;
+		scene.cgTolerance = cgTolerance;
+		scene.xpbdIterations = xpbdIterations;
+		scene.collisionRadius = collisionRadius;
+		scene.sleepThreshold = sleepThreshold;
+		scene.sleepSteps = sleepSteps;
+
+		SceneLattice description;
+		description.sizeX = sizeX;
+		description.sizeY = sizeY;
+		description.extentX = extentX;
+		description.extentY = extentY;
+		description.coefficient = coeff;
+		description.dampening = damp;
+		scene.lattices.push_back(description);
+	}
+	dt = scene.physicsStep;
+
+	size_t numLattices = scene.lattices.size();
+	if (numLattices > 1 && (loadPath != nullptr || savePath != nullptr || recordPath != nullptr))
+	{
+		printf("--load, --save and --record need a scene with a single lattice\n");
+		return 1;
+	}
+
+	SoftBodySolver solver(scene.threads, maxISA);
+	ConfigureSceneSolver(solver, scene);
+
+	//Every lattice is packed into one world and stepped together, except a restored one, which the
+	//world steps where it was mapped; it is declared first so it outlives the world
+	SoftBody restored;
+	World world;
+	if (loadPath != nullptr)
+	{
+		std::chrono::high_resolution_clock::time_point loadStart = std::chrono::high_resolution_clock::now();
+		if (!LoadSoftBody(restored, loadPath))
+		{
+			printf("Can't load snapshot: %s\n", loadPath);
+			return 1;
+		}
+		world.Adopt(restored);
+		world.bodies[0]->integrator = scene.lattices[0].integrator;
+		double loadSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - loadStart).count();
+		printf("Restored from: %s in %.3f ms\n", loadPath, loadSeconds * 1000.0);
+	}
+	else
+	{
+		BuildSceneWorld(scene, world);
+	}
+
+	const char* integratorNames[] = { "explicit Euler", "implicit Euler", "XPBD" };
+	unsigned long long totalParticles = 0;
+	unsigned long long totalSprings = 0;
+	bool implicit = false;
+	for (size_t l = 0; l < numLattices; ++l)
+	{
+		const SoftBody &body = world.bodies[l]->view;
+		int integrator = world.bodies[l]->integrator < 0 ? solver.integrator : world.bodies[l]->integrator;
+		printf("Lattice: %dx%d (%u particles, %u springs), %s\n", body.subdivisionsX, body.subdivisionsY, body.numParticles, body.springs.count,
+			integratorNames[integrator]);
+		totalParticles += body.numParticles;
+		totalSprings += body.springs.count;
+		implicit = implicit || integrator == INTEGRATOR_IMPLICIT_EULER;
+	}
+	printf("Spring force kernel: %s\n", GetSpringKernelName(solver.isa));
+	printf("Solver threads: %d%s\n", solver.pool->numThreads, solver.deterministic ? " (deterministic)" : "");
+	printf("World arena: %.1f MB%s\n", world.arena.capacity / (1024.0 * 1024.0), world.arena.hugePages ? " (huge pages)" : "");
+	SoftBody &first = world.bodies[0]->view;
+
+	if (scene.collisionRadius > 0.0f)
+	{
+		printf("Self-collision radius: %g\n", scene.collisionRadius);
+	}
+
+	//Sleeping only applies to explicit Euler bodies; count the tiles it can put to sleep
+	unsigned long long totalTiles = 0;
+	if (scene.sleepThreshold > 0.0f)
+	{
+		for (size_t l = 0; l < numLattices; ++l)
+		{
+			const SoftBody &body = world.bodies[l]->view;
+			int integrator = world.bodies[l]->integrator < 0 ? solver.integrator : world.bodies[l]->integrator;
+			if (integrator != INTEGRATOR_EXPLICIT_EULER) continue;
+			totalTiles += (unsigned long long)((body.subdivisionsX + SLEEP_TILE_SIZE - 1) / SLEEP_TILE_SIZE) *
+				((body.subdivisionsY + SLEEP_TILE_SIZE - 1) / SLEEP_TILE_SIZE);
+		}
+		printf("Sleep threshold: %g after %d steps (%llu tiles of %dx%d)\n", scene.sleepThreshold, scene.sleepSteps, totalTiles,
+			SLEEP_TILE_SIZE, SLEEP_TILE_SIZE);
+	}
+
+	TrajectoryRecorder recorder;
+	if (recordPath != nullptr)
+	{
+		if (!recorder.Open(recordPath, first.numParticles, quantum, (uint32_t)keyframeInterval))
+		{
+			printf("Can't write trajectory: %s\n", recordPath);
+			return 1;
+		}
+		recorder.Record(first.particles, 0.0);
+	}
+
+	if (tracePath != nullptr)
+	{
+		ProfilerSetThreadName("Main");
+		ProfilerEnable(true);
+	}
+
+	//The headless runner steps as fast as it can, so nothing is clamped and every batch is one step
+	SimulationMetrics metrics;
+	MetricsExporter metricsExporter;
+	if (metricsPath != nullptr || metricsPort > 0)
+	{
+		if (!metricsExporter.Start(metrics.registry, metricsPath, metricsPort, 1.0))
+		{
+			printf("Can't serve metrics on port %d\n", metricsPort);
+			return 1;
+		}
+	}
+
+	//The steps are replayed from a log, chosen by the adaptive controller, or all --dt long
+	StepLogReader replay;
+	AdaptiveStepper stepper;
+	bool adaptive = false;
+	if (replayPath != nullptr)
+	{
+		if (!replay.Open(replayPath))
+		{
+			printf("Can't read step log: %s\n", replayPath);
+			return 1;
+		}
+		printf("Replaying steps from: %s\n", replayPath);
+	}
+	else if (ConfigureSceneStepper(stepper, scene))
+	{
+		adaptive = true;
+		printf("Adaptive step: %g to %g s, tolerance %g\n", stepper.minStep, stepper.maxStep, stepper.tolerance);
+	}
+
+	StepLogWriter stepLog;
+	if (stepLogPath != nullptr && !stepLog.Open(stepLogPath))
+	{
+		printf("Can't write step log: %s\n", stepLogPath);
+		return 1;
+	}
+
+	long long totalCGIterations = 0;
+	long long totalContacts = 0;
+	long long totalAwakeTiles = 0;
+	double duration = steps * (double)dt;
+	double simulated = 0.0;
+	float shortest = 0.0f, longest = 0.0f;
+	steps = 0;
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for (;;)
+	{
+		float stepLength = dt;
+		float stepX = forceX, stepY = forceY;
+		if (replayPath != nullptr)
+		{
+			if (!replay.Next(stepLength, stepX, stepY)) break;
+		}
+		else if (duration - simulated <= 1e-6 * dt) break;	//Adaptive steps are floats and may not add up exactly
+
+		PROFILE_ZONE("Frame");
+		std::chrono::high_resolution_clock::time_point stepStart = std::chrono::high_resolution_clock::now();
+		if (adaptive)
+		{
+			stepLength = stepper.Step(world, solver, (float)(duration - simulated), stepX, stepY, stepLogPath != nullptr ? &stepLog : nullptr);
+		}
+		else
+		{
+			world.Step(solver, stepLength, stepX, stepY);
+			stepLog.Append(stepLength, stepX, stepY);
+		}
+		simulated += stepLength;
+		shortest = steps == 0 || stepLength < shortest ? stepLength : shortest;
+		longest = stepLength > longest ? stepLength : longest;
+		++steps;
+
+		totalCGIterations += world.cgIterations;
+		totalContacts += world.contacts;
+		totalAwakeTiles += world.awakeTiles;
+		metrics.stepSeconds.Observe(std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - stepStart).count());
+		metrics.steps.Add(1.0);
+		metrics.frames.Add(1.0);
+		metrics.substeps.Observe(1.0);
+		metrics.simulatedSeconds.Add(stepLength);
+		if (recordPath != nullptr) recorder.Record(first.particles, simulated);
+	}
+	std::chrono::high_resolution_clock::time_point finish = std::chrono::high_resolution_clock::now();
+
+	if (!stepLog.Close())
+	{
+		printf("Can't write step log: %s\n", stepLogPath);
+		return 1;
+	}
+	if (stepLogPath != nullptr)
+	{
+		printf("Step log written to: %s (%llu steps)\n", stepLogPath, (unsigned long long)stepLog.stepsWritten);
+	}
+
+	if (!metricsExporter.Stop())
+	{
+		printf("Can't write metrics: %s\n", metricsPath);
+		return 1;
+	}
+	if (metricsPath != nullptr)
+	{
+		printf("Metrics written to: %s\n", metricsPath);
+	}
+
+	if (tracePath != nullptr)
+	{
+		if (!ProfilerWriteTrace(tracePath))
+		{
+			printf("Can't write trace: %s\n", tracePath);
+			return 1;
+		}
+		printf("Trace written to: %s\n", tracePath);
+	}
+
+	if (recordPath != nullptr)
+	{
+		if (!recorder.Close())
+		{
+			printf("Can't write trajectory: %s\n", recordPath);
+			return 1;
+		}
+		double rawBytes = (double)recorder.framesWritten * totalParticles * 2 * sizeof(float);
+		printf("Recorded: %llu frames, %.1f MB (%.2f bytes/particle/frame, %.1fx smaller than raw)\n",
+			(unsigned long long)recorder.framesWritten, recorder.bytesWritten / 1e6,
+			recorder.bytesWritten / ((double)recorder.framesWritten * totalParticles),
+			rawBytes / recorder.bytesWritten);
+	}
+
+	double seconds = std::chrono::duration<double>(finish - start).count();
+	double stepsPerSecond = seconds > 0.0 ? steps / seconds : 0.0;
+	//An adaptive step solves the world three times, and so does each attempt thrown away
+	double worldSteps = adaptive ? 3.0 * ((double)steps + stepper.rejections) : (double)steps;
+	double nsPerSpring = worldSteps > 0.0 ? seconds * 1e9 / (worldSteps * totalSprings) : 0.0;
+
+	printf("Steps: %d in %.3f s\n", steps, seconds);
+	printf("Steps/s: %.1f\n", stepsPerSecond);
+	printf("Simulated/real time: %.2f\n", seconds > 0.0 ? simulated / seconds : 0.0);
+	if (steps > 0 && (adaptive || replayPath != nullptr))
+	{
+		printf("Step length: %.6g s mean, %.6g min, %.6g max\n", simulated / steps, shortest, longest);
+	}
+	if (adaptive)
+	{
+		printf("Rejected steps: %u\n", stepper.rejections);
+	}
+	printf("ns/spring/step: %.3f\n", nsPerSpring);
+	if (implicit && steps > 0)
+	{
+		printf("CG iterations/step: %.2f\n", (double)totalCGIterations / steps);
+	}
+	if (scene.collisionRadius > 0.0f && steps > 0)
+	{
+		printf("Contacts/step: %.2f\n", (double)totalContacts / steps);
+	}
+	if (totalTiles > 0 && steps > 0)
+	{
+		printf("Awake tiles: %.1f%% (last step %.1f%%)\n", 100.0 * totalAwakeTiles / ((double)totalTiles * steps),
+			100.0 * world.awakeTiles / totalTiles);
+	}
+
+	//Report a blown up simulation rather than timing it as if it were fine
+	for (size_t l = 0; l < numLattices; ++l)
+	{
+		const SoftBody &body = world.bodies[l]->view;
+		for (unsigned int i = 0; i < body.numParticles; ++i)
+		{
+			if (!std::isfinite(body.particles.x[i]) || !std::isfinite(body.particles.y[i]))
+			{
+				printf("Simulation diverged: particle %u of lattice %d is not finite\n", i, (int)l + 1);
+				return 2;
+			}
+		}
+	}
+
+	if (savePath != nullptr)
+	{
+		if (!SaveSoftBody(first, savePath))
+		{
+			printf("Can't write snapshot: %s\n", savePath);
+			return 1;
+		}
+		printf("Saved to: %s\n", savePath);
+	}
+
+	//Checked last, so a mismatch still leaves the snapshot to investigate
+	if (printHash || expectedHash != nullptr)
+	{
+		unsigned long long hash = (unsigned long long)world.StateHash();
+		printf("State hash: %016llx\n", hash);
+		if (expectedHash != nullptr && strtoull(expectedHash, nullptr, 16) != hash)
+		{
+			printf("State hash does not match the expected %s\n", expectedHash);
+			return 3;
+		}
+	}
+
+	return 0;
+}
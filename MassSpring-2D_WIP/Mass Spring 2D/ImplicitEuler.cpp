@@ -0,0 +1,349 @@
+/*
+Backward Euler integrator
+
+Explicit Euler is only stable while the timestep is small compared to the period of the stiffest
+spring. Backward Euler evaluates the forces at the end of the step instead, which is stable for any
+timestep. Linearising the forces about the current state gives one linear system per step for the
+change in velocity dV (Baraff & Witkin, "Large Steps in Cloth Simulation"):
+
+	(M - h*D - h^2*K) dV = h * (F + h*K*V)
+
+where M is the mass matrix, K = dF/dX is the spring Jacobian and D = dF/dV the dampening Jacobian.
+Every spring contributes a symmetric 2x2 block to K:
+
+	Ks = k * n*n^T + k * max(0, 1 - rest/L) * (I - n*n^T)
+
+The transverse term is clamped at zero for compressed springs so that the system stays positive
+definite. Each particle's dampening is -C*V per attached spring, so D is diagonal.
+
+The system is solved with conjugate gradients preconditioned by its diagonal. The matrix is never
+assembled: every product is one pass over the springs, split across the same bands of rows as the
+explicit solver. Particles with infinite mass are constrained to dV = 0 by filtering them out of
+the residual and search directions. Dot products are summed per band and then in band order, so
+the solve is as deterministic as the explicit passes.
+*/
+
+#include "SoftBodySolver.h"
+
+#include <cmath>
+#include <vector>
+
+///
+//Runs a function once per band of rows with that band's particle range
+//
+//Parameters:
+//	pool: The threads to run on
+//	body: The softbody being solved
+//	bands: The number of bands
+//	func: Called with the band index and its first and end particle
+template <typename Func>
+static void ForEachBand(ThreadPool &pool, const SoftBody &body, int bands, const Func &func)
+{
+	pool.Run(bands, [&](int band)
+	{
+		int firstRow, endRow;
+		ThreadPool::Partition(body.subdivisionsY, bands, band, firstRow, endRow);
+		func(band, (unsigned int)(firstRow * body.subdivisionsX), (unsigned int)(endRow * body.subdivisionsX));
+	});
+}
+
+///
+//Computes out = diagScale * (M - h*D) * in + h^2 * (-K) * in.
+//With diagScale 0 this is only the stiffness product.
+//
+//Parameters:
+//	body: The softbody being solved
+//	system: The implicit system, with the spring stiffness blocks assembled
+//	pool: The threads to run on
+//	bands: The number of bands
+//	h: The timestep
+//	diagScale: The scale of the mass and dampening term
+//	inX, inY: The vector being multiplied
+//	outX, outY: The result
+static void MultiplySystem(SoftBody &body, ImplicitSystem &system, ThreadPool &pool, int bands, float h, float diagScale,
+	const float* inX, const float* inY, float* outX, float* outY)
+{
+	const ParticleStore &p = body.particles;
+	const SpringTable &springs = body.springs;
+	float h2 = h * h;
+	float hDamp = h * body.dampening;
+
+	//Diagonal term, then every spring in the band.
+	//A spring leaving the band only writes its first particle, the second is left for the next pass.
+	ForEachBand(pool, body, bands, [&](int /*band*/, unsigned int first, unsigned int end)
+	{
+		for (unsigned int i = first; i < end; ++i)
+		{
+			float mass = p.invMass[i] == 0.0f ? 0.0f : 1.0f / p.invMass[i];
+			float diag = diagScale * (mass + hDamp * system.degree[i]);
+			outX[i] = diag * inX[i];
+			outY[i] = diag * inY[i];
+		}
+
+		unsigned int begin = springs.LowerBound(first);
+		unsigned int last = springs.LowerBound(end);
+		for (unsigned int s = begin; s < last; ++s)
+		{
+			unsigned int a = springs.a[s];
+			unsigned int b = springs.b[s];
+
+			//-K applied to a spring is Ks * (in_a - in_b) on a and the negation on b
+			float dx = inX[a] - inX[b];
+			float dy = inY[a] - inY[b];
+			float yx = h2 * (system.kxx[s] * dx + system.kxy[s] * dy);
+			float yy = h2 * (system.kxy[s] * dx + system.kyy[s] * dy);
+
+			outX[a] += yx;
+			outY[a] += yy;
+			if (b < end)
+			{
+				outX[b] -= yx;
+				outY[b] -= yy;
+			}
+			else
+			{
+				system.springX[s] = yx;
+				system.springY[s] = yy;
+			}
+		}
+	});
+
+	//Springs crossing into the next band
+	ForEachBand(pool, body, bands, [&](int /*band*/, unsigned int first, unsigned int end)
+	{
+		if (end > first)
+		{
+			unsigned int begin = springs.LowerBound(end - body.subdivisionsX);
+			unsigned int last = springs.LowerBound(end);
+			for (unsigned int s = begin; s < last; ++s)
+			{
+				unsigned int b = springs.b[s];
+				if (b >= end)
+				{
+					outX[b] -= system.springX[s];
+					outY[b] -= system.springY[s];
+				}
+			}
+		}
+	});
+}
+
+///
+//Computes the dot product of two 2D vector fields, summed per band then in band order
+//
+//Parameters:
+//	body: The softbody being solved
+//	pool: The threads to run on
+//	bands: The number of bands
+//	partial: Scratch space for one sum per band
+//	ax, ay: The first vector
+//	bx, by: The second vector
+static double Dot(const SoftBody &body, ThreadPool &pool, int bands, std::vector<double> &partial,
+	const float* ax, const float* ay, const float* bx, const float* by)
+{
+	ForEachBand(pool, body, bands, [&](int band, unsigned int first, unsigned int end)
+	{
+		double sum = 0.0;
+		for (unsigned int i = first; i < end; ++i)
+		{
+			sum += (double)ax[i] * bx[i] + (double)ay[i] * by[i];
+		}
+		partial[band] = sum;
+	});
+
+	double total = 0.0;
+	for (int band = 0; band < bands; ++band)
+	{
+		total += partial[band];
+	}
+	return total;
+}
+
+int StepImplicitEuler(SoftBody &body, ImplicitSystem &system, ThreadPool &pool, int bands, SpringForceKernel kernel,
+	float dt, float externalX, float externalY, int maxIterations, float tolerance)
+{
+	ParticleStore &p = body.particles;
+	SpringTable &springs = body.springs;
+	ImplicitSystem &sys = system;
+	float h = dt;
+	float h2 = h * h;
+	float hDamp = h * body.dampening;
+	int width = body.subdivisionsX;
+
+	sys.Resize(body.numParticles, springs);
+	std::vector<double> partial(bands);
+
+	//Current forces F: springs, dampening and the external force on the bottom row
+	ForEachBand(pool, body, bands, [&](int /*band*/, unsigned int first, unsigned int end)
+	{
+		ApplySpringForces(body, kernel, first / width, end / width);
+	});
+	ForEachBand(pool, body, bands, [&](int /*band*/, unsigned int /*first*/, unsigned int end)
+	{
+		ApplyBoundarySpringForces(body, end / width);
+	});
+	for (int j = 0; j < width; ++j)
+	{
+		p.fx[j] += externalX;
+		p.fy[j] += externalY;
+	}
+
+	//Stiffness block of every spring
+	ForEachBand(pool, body, bands, [&](int /*band*/, unsigned int first, unsigned int end)
+	{
+		unsigned int begin = springs.LowerBound(first);
+		unsigned int last = springs.LowerBound(end);
+		for (unsigned int s = begin; s < last; ++s)
+		{
+			unsigned int a = springs.a[s];
+			unsigned int b = springs.b[s];
+			float dx = p.x[b] - p.x[a];
+			float dy = p.y[b] - p.y[a];
+			float len = sqrtf(dx * dx + dy * dy);
+			float nx = dx / len;
+			float ny = dy / len;
+
+			float k = springs.stiffness[s];
+			float transverse = 1.0f - springs.restLength[s] / len;
+			float c = k * (transverse > 0.0f ? transverse : 0.0f);
+
+			sys.kxx[s] = k * nx * nx + c * (1.0f - nx * nx);
+			sys.kxy[s] = (k - c) * nx * ny;
+			sys.kyy[s] = k * ny * ny + c * (1.0f - ny * ny);
+		}
+	});
+
+	//Right hand side b = h * F + h^2 * K * V. MultiplySystem gives -h^2 * K * V with no diagonal term.
+	MultiplySystem(body, sys, pool, bands, h, 0.0f, p.vx, p.vy, sys.bx, sys.by);
+
+	//Initial guess dV = 0, so r = b; the preconditioner is the inverse diagonal of the system
+	ForEachBand(pool, body, bands, [&](int /*band*/, unsigned int first, unsigned int end)
+	{
+		for (unsigned int i = first; i < end; ++i)
+		{
+			sys.dvx[i] = sys.dvy[i] = 0.0f;
+			if (p.invMass[i] == 0.0f)
+			{
+				sys.bx[i] = sys.by[i] = 0.0f;
+				sys.precondX[i] = sys.precondY[i] = 0.0f;
+			}
+			else
+			{
+				sys.bx[i] = h * p.fx[i] - sys.bx[i];
+				sys.by[i] = h * p.fy[i] - sys.by[i];
+				sys.precondX[i] = sys.precondY[i] = 1.0f / p.invMass[i] + hDamp * sys.degree[i];
+			}
+
+			sys.rx[i] = sys.bx[i];
+			sys.ry[i] = sys.by[i];
+		}
+	});
+
+	//Add the stiffness diagonal to the preconditioner then invert it
+	ForEachBand(pool, body, bands, [&](int /*band*/, unsigned int first, unsigned int end)
+	{
+		unsigned int begin = springs.LowerBound(first);
+		unsigned int last = springs.LowerBound(end);
+		for (unsigned int s = begin; s < last; ++s)
+		{
+			unsigned int a = springs.a[s];
+			sys.precondX[a] += h2 * sys.kxx[s];
+			sys.precondY[a] += h2 * sys.kyy[s];
+		}
+	});
+	ForEachBand(pool, body, bands, [&](int /*band*/, unsigned int first, unsigned int end)
+	{
+		//Second particles of springs; every one of these lies in this band or the band before
+		unsigned int begin = springs.LowerBound(first >= (unsigned int)width ? first - width : 0);
+		unsigned int last = springs.LowerBound(end);
+		for (unsigned int s = begin; s < last; ++s)
+		{
+			unsigned int b = springs.b[s];
+			if (b >= first && b < end)
+			{
+				sys.precondX[b] += h2 * sys.kxx[s];
+				sys.precondY[b] += h2 * sys.kyy[s];
+			}
+		}
+
+		for (unsigned int i = first; i < end; ++i)
+		{
+			bool constrained = p.invMass[i] == 0.0f;
+			sys.precondX[i] = constrained ? 0.0f : 1.0f / sys.precondX[i];
+			sys.precondY[i] = constrained ? 0.0f : 1.0f / sys.precondY[i];
+
+			sys.zx[i] = sys.precondX[i] * sys.rx[i];
+			sys.zy[i] = sys.precondY[i] * sys.ry[i];
+			sys.px[i] = sys.zx[i];
+			sys.py[i] = sys.zy[i];
+		}
+	});
+
+	double bb = Dot(body, pool, bands, partial, sys.bx, sys.by, sys.bx, sys.by);
+	double threshold = (double)tolerance * tolerance * bb;
+	double rz = Dot(body, pool, bands, partial, sys.rx, sys.ry, sys.zx, sys.zy);
+
+	int iterations = 0;
+	while (iterations < maxIterations && bb > 0.0)
+	{
+		++iterations;
+
+		//q = A * p
+		MultiplySystem(body, sys, pool, bands, h, 1.0f, sys.px, sys.py, sys.qx, sys.qy);
+
+		double pq = Dot(body, pool, bands, partial, sys.px, sys.py, sys.qx, sys.qy);
+		if (pq <= 0.0) break;
+		float alpha = (float)(rz / pq);
+
+		//dV += alpha * p, r -= alpha * q
+		//Constrained particles have p = 0, and their residual is kept at 0
+		ForEachBand(pool, body, bands, [&](int /*band*/, unsigned int first, unsigned int end)
+		{
+			for (unsigned int i = first; i < end; ++i)
+			{
+				if (p.invMass[i] == 0.0f) continue;
+
+				sys.dvx[i] += alpha * sys.px[i];
+				sys.dvy[i] += alpha * sys.py[i];
+				sys.rx[i] -= alpha * sys.qx[i];
+				sys.ry[i] -= alpha * sys.qy[i];
+				sys.zx[i] = sys.precondX[i] * sys.rx[i];
+				sys.zy[i] = sys.precondY[i] * sys.ry[i];
+			}
+		});
+
+		double rr = Dot(body, pool, bands, partial, sys.rx, sys.ry, sys.rx, sys.ry);
+		if (rr <= threshold) break;
+
+		double rzNext = Dot(body, pool, bands, partial, sys.rx, sys.ry, sys.zx, sys.zy);
+		float beta = (float)(rzNext / rz);
+		rz = rzNext;
+
+		//p = z + beta * p
+		ForEachBand(pool, body, bands, [&](int /*band*/, unsigned int first, unsigned int end)
+		{
+			for (unsigned int i = first; i < end; ++i)
+			{
+				sys.px[i] = sys.zx[i] + beta * sys.px[i];
+				sys.py[i] = sys.zy[i] + beta * sys.py[i];
+			}
+		});
+	}
+
+	//V += dV, X += h * V
+	ForEachBand(pool, body, bands, [&](int /*band*/, unsigned int first, unsigned int end)
+	{
+		for (unsigned int i = first; i < end; ++i)
+		{
+			p.vx[i] += sys.dvx[i];
+			p.vy[i] += sys.dvy[i];
+			p.x[i] += h * p.vx[i];
+			p.y[i] += h * p.vy[i];
+
+			//Zero the net force!
+			p.fx[i] = p.fy[i] = 0.0f;
+		}
+	});
+
+	return iterations;
+}
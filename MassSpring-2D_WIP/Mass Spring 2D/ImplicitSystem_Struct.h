@@ -0,0 +1,107 @@
+#ifndef _IMPLICITSYSTEM_STRUCT_H
+#define _IMPLICITSYSTEM_STRUCT_H
+
+#include "AlignedMemory.h"
+#include "SpringTable_Struct.h"
+
+//Working storage for the backward Euler integrator.
+//The system matrix is never assembled; instead the 2x2 stiffness block of every spring is kept
+//and the matrix is applied spring by spring inside the conjugate gradient iterations.
+struct ImplicitSystem
+{
+	unsigned int numParticles;	//The number of particles the per-particle arrays have room for
+	unsigned int numSprings;	//The number of springs the per-spring arrays have room for
+	const unsigned int* topology;	//The spring table the degrees were counted from
+
+	//Per spring: the symmetric stiffness block dF/dX of the spring, and a scratch vector
+	float* kxx;
+	float* kxy;
+	float* kyy;
+	float* springX;
+	float* springY;
+
+	//Per particle: the number of springs attached, which scales the dampening
+	float* degree;
+
+	//Per particle, two components each: right hand side, solution, residual,
+	//preconditioned residual, search direction, matrix times search direction
+	//and inverse of the Jacobi preconditioner
+	float* bx; float* by;
+	float* dvx; float* dvy;
+	float* rx; float* ry;
+	float* zx; float* zy;
+	float* px; float* py;
+	float* qx; float* qy;
+	float* precondX; float* precondY;
+
+	///
+	//Default constructor, creates an empty system
+	ImplicitSystem()
+	{
+		numParticles = numSprings = 0;
+		topology = nullptr;
+		kxx = kxy = kyy = springX = springY = degree = nullptr;
+		bx = by = dvx = dvy = rx = ry = zx = zy = px = py = qx = qy = precondX = precondY = nullptr;
+	}
+
+	~ImplicitSystem()
+	{
+		Release();
+	}
+
+	///
+	//Makes room for the given softbody's particles and springs and counts the springs on each particle.
+	//Does nothing if the system was last sized for the same spring table.
+	//
+	//Parameters:
+	//	particles: The number of particles in the softbody
+	//	springs: The softbody's springs
+	void Resize(unsigned int particles, const SpringTable &springs)
+	{
+		if (particles == numParticles && springs.count == numSprings && springs.a == topology) return;
+
+		if (particles != numParticles || springs.count != numSprings)
+		{
+			Release();
+			numParticles = particles;
+			numSprings = springs.count;
+
+			size_t springSize = sizeof(float) * numSprings;
+			kxx = (float*)AlignedAlloc(springSize);
+			kxy = (float*)AlignedAlloc(springSize);
+			kyy = (float*)AlignedAlloc(springSize);
+			springX = (float*)AlignedAlloc(springSize);
+			springY = (float*)AlignedAlloc(springSize);
+
+			float** particleArrays[] = { &degree, &bx, &by, &dvx, &dvy, &rx, &ry, &zx, &zy, &px, &py, &qx, &qy, &precondX, &precondY };
+			for (size_t i = 0; i < sizeof(particleArrays) / sizeof(particleArrays[0]); ++i)
+			{
+				*particleArrays[i] = (float*)AlignedAlloc(sizeof(float) * numParticles);
+			}
+		}
+
+		topology = springs.a;
+		memset(degree, 0, sizeof(float) * numParticles);
+		for (unsigned int s = 0; s < springs.count; ++s)
+		{
+			degree[springs.a[s]] += 1.0f;
+			degree[springs.b[s]] += 1.0f;
+		}
+	}
+
+	///
+	//Frees all arrays
+	void Release()
+	{
+		float** arrays[] = { &kxx, &kxy, &kyy, &springX, &springY, &degree, &bx, &by, &dvx, &dvy, &rx, &ry, &zx, &zy, &px, &py, &qx, &qy, &precondX, &precondY };
+		for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++i)
+		{
+			AlignedFree(*arrays[i]);
+			*arrays[i] = nullptr;
+		}
+		numParticles = numSprings = 0;
+		topology = nullptr;
+	}
+};
+
+#endif //_IMPLICITSYSTEM_STRUCT_H
@@ -0,0 +1,43 @@
+/*
+Lattice meshes
+
+Each row of cells is written with a running pointer rather than an index computed from the row and
+column, so nothing depends on the lattice being square and the arithmetic stays in size_t for
+lattices past the range of an int.
+*/
+
+#include "LatticeMesh.h"
+
+size_t LatticeQuadIndexCount(int width, int height)
+{
+	if (width < 2 || height < 2) return 0;
+	return 4 * (size_t)(width - 1) * (size_t)(height - 1);
+}
+
+void WriteLatticeQuadIndices(int width, int height, unsigned int* dest)
+{
+	for (int i = 0; i < height - 1; ++i)
+	{
+		unsigned int bottom = (unsigned int)i * (unsigned int)width;
+		unsigned int top = bottom + (unsigned int)width;
+		for (int j = 0; j < width - 1; ++j)
+		{
+			dest[0] = bottom + j;
+			dest[1] = bottom + j + 1;
+			dest[2] = top + j + 1;
+			dest[3] = top + j;
+			dest += 4;
+		}
+	}
+}
+
+void FillVertexColors(float* dest, size_t count, float r, float g, float b, float a)
+{
+	for (size_t i = 0; i < count; ++i, dest += 4)
+	{
+		dest[0] = r;
+		dest[1] = g;
+		dest[2] = b;
+		dest[3] = a;
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef _LATTICE_MESH_H
+#define _LATTICE_MESH_H
+
+#include <cstddef>
+
+//Generates the render data of a softbody lattice of any size.
+//
+//Vertex n is point mass n, which the softbody numbers row by row from the bottom left, so the
+//positions WriteVertexPositions produces line up with these indices for any width and height.
+//Everything is written straight into the caller's memory, typically a mapped GPU buffer, so a lattice
+//of millions of masses never needs a temporary copy of its mesh.
+
+///
+//Returns the number of indices WriteLatticeQuadIndices writes: four per cell
+//
+//Parameters:
+//	width: The number of point masses along X
+//	height: The number of point masses along Y
+size_t LatticeQuadIndexCount(int width, int height);
+
+///
+//Writes the indices of one quad per lattice cell, counter-clockwise from the cell's bottom left mass
+//
+//Parameters:
+//	width: The number of point masses along X
+//	height: The number of point masses along Y
+//	dest: Where to write LatticeQuadIndexCount(width, height) indices
+void WriteLatticeQuadIndices(int width, int height, unsigned int* dest);
+
+///
+//Gives every vertex of a mesh the same colour
+//
+//Parameters:
+//	dest: Where to write four floats per vertex
+//	count: The number of vertices
+//	r, g, b, a: The colour
+void FillVertexColors(float* dest, size_t count, float r, float g, float b, float a);
+
+#endif //_LATTICE_MESH_H
@@ -0,0 +1,88 @@
+/*
+Memory mapped files
+
+Maps with MAP_PRIVATE on POSIX systems and FILE_MAP_COPY on Windows, both of which give
+copy-on-write pages: reading a page costs a page fault and no copy, writing one copies only that page.
+*/
+
+#include "MappedFile_Struct.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(file, &length) || length.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	//The mapping object keeps the file open once it exists
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mapping == nullptr) return false;
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	data = view;
+	size = (size_t)length.QuadPart;
+	handle = mapping;
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0) return false;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0)
+	{
+		close(file);
+		return false;
+	}
+
+	//The mapping keeps the file open once it exists
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+	if (view == MAP_FAILED) return false;
+
+	data = view;
+	size = (size_t)info.st_size;
+#endif
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data == nullptr) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)handle);
+#else
+	munmap(data, size);
+#endif
+
+	data = nullptr;
+	size = 0;
+	handle = nullptr;
+}
@@ -0,0 +1,68 @@
+#ifndef _MAPPEDFILE_STRUCT_H
+#define _MAPPEDFILE_STRUCT_H
+
+#include <cstddef>
+
+//A whole file mapped into memory copy-on-write.
+//Pages are read from the file the first time they are touched, and writes go to private copies
+//of the pages, so the mapping can back live simulation arrays without ever changing the file.
+struct MappedFile
+{
+	void* data;			//The start of the mapping, page aligned, or nullptr if no file is open
+	size_t size;		//The size of the file in bytes
+	void* handle;		//Windows: the file mapping object
+
+	///
+	//Default constructor, maps nothing
+	MappedFile()
+	{
+		data = nullptr;
+		size = 0;
+		handle = nullptr;
+	}
+
+	~MappedFile()
+	{
+		Close();
+	}
+
+	///
+	//Maps a file, closing any file mapped before
+	//
+	//Parameters:
+	//	path: The file to map
+	//
+	//Returns:
+	//	False if the file could not be opened or mapped, or is empty
+	bool Open(const char* path);
+
+	///
+	//Unmaps the file. Any arrays pointing into it become invalid.
+	void Close();
+
+	///
+	//Exchanges mappings with another MappedFile. Arrays pointing into either mapping stay valid.
+	//
+	//Parameters:
+	//	other: The mapping to exchange with
+	void Swap(MappedFile &other)
+	{
+		void* otherData = other.data;
+		size_t otherSize = other.size;
+		void* otherHandle = other.handle;
+
+		other.data = data;
+		other.size = size;
+		other.handle = handle;
+
+		data = otherData;
+		size = otherSize;
+		handle = otherHandle;
+	}
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+#endif //_MAPPEDFILE_STRUCT_H
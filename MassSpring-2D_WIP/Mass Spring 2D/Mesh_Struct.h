@@ -1,14 +1,22 @@
-#ifndef _MESH_STRUCT_H
-#define _MESH_STRUCT_H
-
-
+#ifndef _MESH_STRUCT_H
+#define _MESH_STRUCT_H
+
+
 #include "GLRender.h"
+#include "Vertex_Struct.h"
+
+#include <vector>
+
+//The number of regions in a streaming mesh's position ring.
+//The CPU writes one region while the GPU may still be reading the other two.
+#define MESH_STREAM_REGIONS 3
 
 
 //Struct for rendering
 struct Mesh
 {
-	GLuint VBO;
+	GLuint VBO;			//Positions, two floats per vertex, rewritten as the mesh deforms
+	GLuint colorVBO;	//Colours, four floats per vertex, uploaded once
 	GLuint EBO;
 	GLuint VAO;
 	glm::mat4 translation;
@@ -16,25 +24,43 @@ struct Mesh
 	glm::mat4 scale;
 	int numVertices;
 	int numIndices;
-	struct Vertex* vertices;
-	GLuint* indices;
+	float* positions;	//x, y of each vertex when not streaming; the z of a 2D mesh is always zero and is not stored
 	GLenum primitive;
 
-	Mesh::Mesh(int numVert, struct Vertex* vert, int numInd, GLuint* inds, GLenum primType)
-	{
+	//Streaming: the position buffer holds MESH_STREAM_REGIONS copies of the positions and stays mapped,
+	//so new positions are written straight into GPU visible memory instead of being copied every frame.
+	bool streaming;									//Whether the persistent mapped ring is in use
+	float* mapped;									//The persistent mapping of the whole ring
+	int writeRegion;								//The region the CPU is writing
+	int drawRegion;									//The region the GPU draws from
+	bool written;									//Whether the write region holds a complete new frame
+	GLsync fences[MESH_STREAM_REGIONS];				//Signalled when the GPU is done drawing each region
 
-		glm::mat4 translation = glm::mat4(1.0f);
-		glm::mat4 rotation = glm::mat4(1.0f);
-		glm::mat4 scale = glm::mat4(1.0f);
+	//Draw ranges: when set, each range of the indices is drawn with its own base vertex in one multi-draw,
+	//so a mesh of several objects can keep indices relative to each object's first vertex
+	std::vector<GLsizei> rangeCounts;				//The number of indices of each range
+	std::vector<void*> rangeOffsets;				//The byte offset of each range in the index buffer
+	std::vector<GLint> rangeBaseVertices;			//Added to every index of each range
 
-		this->numVertices = numVert;
-		this->vertices = new struct Vertex[this->numVertices];
-		memcpy(this->vertices, vert, this->numVertices * sizeof(struct Vertex));
+	///
+	//Parameterized constructor, creates the buffers of a mesh without filling them.
+	//Write the colours and indices through MapColors and MapIndices, and the positions through
+	//GetWritePositions, so large meshes go straight into GPU memory without a CPU side copy.
+	//
+	//Parameters:
+	//	numVert: The number of vertices
+	//	numInd: The number of indices
+	//	primType: The primitive the indices describe
+	//	stream: Whether to stream the positions through a persistent mapped ring. Falls back to
+	//		glMapBuffer uploads if the context lacks ARB_buffer_storage.
+	Mesh(int numVert, int numInd, GLenum primType, bool stream = false)
+	{
+		this->translation = glm::mat4(1.0f);
+		this->rotation = glm::mat4(1.0f);
+		this->scale = glm::mat4(1.0f);
 
+		this->numVertices = numVert;
 		this->numIndices = numInd;
-		this->indices = new GLuint[this->numIndices];
-		memcpy(this->indices, inds, this->numIndices * sizeof(GLuint));
-
 		this->primitive = primType;
 
 		//Generate VAO
@@ -46,44 +72,227 @@ struct Mesh
 		//We must use an element buffer here so that we do not need to worry about duplicate vertices
 		//while we are repositioning the vertices of the mesh
 		glGenBuffers(1, &this->VBO);
+		glGenBuffers(1, &this->colorVBO);
 		glGenBuffers(1, &this->EBO);
 
+		//The colours never change
+		glBindBuffer(GL_ARRAY_BUFFER, this->colorVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 4 * this->numVertices, nullptr, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+
 		//Configure VBO & EBO
 		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(struct Vertex) * this->numVertices, this->vertices, GL_DYNAMIC_DRAW);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * this->numIndices, this->indices, GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * this->numIndices, nullptr, GL_STATIC_DRAW);
+
+		this->streaming = stream && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+		this->positions = nullptr;
+		this->mapped = nullptr;
+		this->writeRegion = 0;
+		this->drawRegion = MESH_STREAM_REGIONS - 1;
+		this->written = false;
+		for (int i = 0; i < MESH_STREAM_REGIONS; ++i)
+		{
+			this->fences[i] = 0;
+		}
+
+		if (this->streaming)
+		{
+			//Immutable storage which stays mapped for the life of the mesh.
+			//Coherent, so CPU writes become visible to the GPU without an explicit flush.
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			GLsizeiptr regionSize = sizeof(float) * 2 * this->numVertices;
+			glBufferStorage(GL_ARRAY_BUFFER, regionSize * MESH_STREAM_REGIONS, nullptr, flags);
+			this->mapped = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, regionSize * MESH_STREAM_REGIONS, flags);
+		}
+		else
+		{
+			this->positions = new float[2 * this->numVertices];
+			glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 2 * this->numVertices, nullptr, GL_DYNAMIC_DRAW);
+		}
 
 		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(struct Vertex), (void*)12);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
 	}
 
-	Mesh::~Mesh(void)
+	///
+	//Parameterized constructor, uploads the mesh.
+	//The colours go into their own static buffer so the per frame upload only carries positions.
+	//
+	//Parameters:
+	//	numVert: The number of vertices
+	//	vert: The vertices
+	//	numInd: The number of indices
+	//	inds: The indices
+	//	primType: The primitive the indices describe
+	//	stream: Whether to stream the positions through a persistent mapped ring. Falls back to
+	//		glMapBuffer uploads if the context lacks ARB_buffer_storage.
+	Mesh(int numVert, struct Vertex* vert, int numInd, GLuint* inds, GLenum primType, bool stream = false)
+		: Mesh(numVert, numInd, primType, stream)
 	{
-		delete[] this->vertices;
+		float* colors = this->MapColors();
+		for (int i = 0; i < this->numVertices; ++i)
+		{
+			colors[4 * i] = vert[i].r;
+			colors[4 * i + 1] = vert[i].g;
+			colors[4 * i + 2] = vert[i].b;
+			colors[4 * i + 3] = vert[i].a;
+		}
+		this->UnmapColors();
+
+		memcpy(this->MapIndices(), inds, this->numIndices * sizeof(GLuint));
+		this->UnmapIndices();
+
+		//Every region of a streaming ring starts out holding the vertices
+		int regions = this->streaming ? MESH_STREAM_REGIONS : 1;
+		for (int r = 0; r < regions; ++r)
+		{
+			float* dest = this->streaming ? this->mapped + r * 2 * this->numVertices : this->positions;
+			for (int i = 0; i < this->numVertices; ++i)
+			{
+				dest[2 * i] = vert[i].x;
+				dest[2 * i + 1] = vert[i].y;
+			}
+		}
+		if (!this->streaming)
+		{
+			glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * 2 * this->numVertices, this->positions);
+		}
+	}
+
+	~Mesh(void)
+	{
+		delete[] this->positions;
+		for (int i = 0; i < MESH_STREAM_REGIONS; ++i)
+		{
+			if (this->fences[i] != 0) glDeleteSync(this->fences[i]);
+		}
 		glDeleteVertexArrays(1, &this->VAO);
 		glDeleteBuffers(1, &this->VBO);
+		glDeleteBuffers(1, &this->colorVBO);
+		glDeleteBuffers(1, &this->EBO);
 	}
 
-	glm::mat4 Mesh::GetModelMatrix()
+	///
+	//Maps the colour buffer for writing, four floats per vertex.
+	//The previous contents are discarded; call UnmapColors once every colour has been written.
+	float* MapColors(void)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, this->colorVBO);
+		return (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(float) * 4 * this->numVertices, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	}
+
+	void UnmapColors(void)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, this->colorVBO);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+	}
+
+	///
+	//Maps the index buffer for writing.
+	//The previous contents are discarded; call UnmapIndices once every index has been written.
+	GLuint* MapIndices(void)
+	{
+		//The element buffer binding belongs to the VAO
+		glBindVertexArray(this->VAO);
+		return (GLuint*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLuint) * this->numIndices, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	}
+
+	void UnmapIndices(void)
+	{
+		glBindVertexArray(this->VAO);
+		glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+	}
+
+	///
+	//Adds a range of the indices to draw. Once any range is added, only ranges are drawn.
+	//
+	//Parameters:
+	//	firstIndex: The first index of the range
+	//	count: The number of indices in the range
+	//	baseVertex: The vertex the range's index 0 refers to
+	void AddDrawRange(size_t firstIndex, GLsizei count, GLint baseVertex)
+	{
+		this->rangeCounts.push_back(count);
+		this->rangeOffsets.push_back((void*)(sizeof(GLuint) * firstIndex));
+		this->rangeBaseVertices.push_back(baseVertex);
+	}
+
+	///
+	//Issues the draw call for the bound buffers: every index, or every range in one multi-draw
+	void DrawIndices(void)
+	{
+		if (this->rangeCounts.empty())
+		{
+			glDrawElements(this->primitive, this->numIndices, GL_UNSIGNED_INT, 0);
+		}
+		else
+		{
+			glMultiDrawElementsBaseVertex(this->primitive, this->rangeCounts.data(), GL_UNSIGNED_INT, this->rangeOffsets.data(),
+				(GLsizei)this->rangeCounts.size(), this->rangeBaseVertices.data());
+		}
+	}
+
+	glm::mat4 GetModelMatrix()
 	{
 		return translation * rotation * scale;
 	}
 
-	void Mesh::RefreshData(void)
+	///
+	//Returns the x, y pairs new positions should be written to. When streaming this is GPU visible memory,
+	//which does not need a GL context to write, so it may be filled from any thread.
+	//It is never read back, so every position must be written each frame.
+	//Call PositionsWritten once every position has been written.
+	float* GetWritePositions(void)
+	{
+		return this->streaming ? this->mapped + this->writeRegion * 2 * this->numVertices : this->positions;
+	}
+
+	///
+	//Marks the positions returned by GetWritePositions as a complete frame, ready for RefreshData
+	void PositionsWritten(void)
+	{
+		this->written = true;
+	}
+
+	void RefreshData(void)
 	{
+		if (this->streaming)
+		{
+			//Nothing to copy, the positions are already in the buffer.
+			//If a new frame was written, draw it and move the CPU on to the next region.
+			if (this->written)
+			{
+				this->drawRegion = this->writeRegion;
+				this->writeRegion = (this->writeRegion + 1) % MESH_STREAM_REGIONS;
+				this->written = false;
+
+				//Wait until the GPU has finished drawing the region from the last time round the ring.
+				//With three regions this has almost always long since happened.
+				GLsync fence = this->fences[this->writeRegion];
+				if (fence != 0)
+				{
+					while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+					glDeleteSync(fence);
+					this->fences[this->writeRegion] = 0;
+				}
+			}
+			return;
+		}
+
 		//BEcause we are changing the vertices themselves and not transforming them
 		//We must write the new vertices over the old on the GPU.
 		glBindVertexArray(VAO);
 
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 		GLvoid* memory = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-		memcpy(memory, vertices, numVertices * sizeof(Vertex));
+		memcpy(memory, positions, numVertices * 2 * sizeof(float));
 		glUnmapBuffer(GL_ARRAY_BUFFER);
 	}
 
-	void Mesh::Draw(void)
+	void Draw(void)
 	{
 		//GEnerate the MVP for this model
 		glm::mat4 MVP = VP * this->GetModelMatrix();
@@ -95,8 +304,22 @@ struct Mesh
 		glUniformMatrix4fv(uniMVP, 1, GL_FALSE, glm::value_ptr(MVP));
 		//Draw the mesh
 		//glDrawArrays(this->primitive, 0, this->numVertices);
-		glDrawElements(this->primitive, this->numIndices, GL_UNSIGNED_INT, 0);
+		if (this->streaming)
+		{
+			//Point the position attribute at the newest region, draw, and fence the region so the
+			//CPU knows when it may be written again. A base vertex would offset the colours as well.
+			glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+			glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)(sizeof(float) * 2 * this->drawRegion * this->numVertices));
+			this->DrawIndices();
+
+			if (this->fences[this->drawRegion] != 0) glDeleteSync(this->fences[this->drawRegion]);
+			this->fences[this->drawRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+		else
+		{
+			this->DrawIndices();
+		}
 	}
 };
-
-#endif _MESH_STRUCT_H
\ No newline at end of file
+
+#endif //_MESH_STRUCT_H
\ No newline at end of file
@@ -0,0 +1,157 @@
+/*
+Metrics
+
+Floating point counters are accumulated with a compare and swap loop, which stays lock free and is
+uncontended in practice since each metric is updated by one thread.
+
+A histogram's buckets are read one at a time while other threads may still be observing, so a scrape
+can see a measurement in the sum but not yet in its bucket. The count is reported as the sum of the
+buckets read, so the buckets and count of one scrape always agree.
+*/
+
+#include "Metrics.h"
+
+#include <cstdio>
+
+///
+//Adds to an atomic double
+static void AtomicAdd(std::atomic<double> &target, double amount)
+{
+	double expected = target.load(std::memory_order_relaxed);
+	while (!target.compare_exchange_weak(expected, expected + amount, std::memory_order_relaxed));
+}
+
+///
+//Formats a number the way the text format expects
+static std::string FormatValue(double value)
+{
+	char text[32];
+	snprintf(text, sizeof(text), "%.15g", value);
+	return text;
+}
+
+///
+//Appends the HELP and TYPE lines of a metric
+static void AppendHeader(std::string &out, const std::string &name, const std::string &help, const char* type)
+{
+	out += "# HELP " + name + " " + help + "\n";
+	out += "# TYPE " + name + " " + type + "\n";
+}
+
+MetricCounter::MetricCounter(const char* counterName, const char* description)
+	: name(counterName), help(description), value(0.0)
+{
+}
+
+void MetricCounter::Add(double amount)
+{
+	AtomicAdd(value, amount);
+}
+
+MetricGauge::MetricGauge(const char* gaugeName, const char* description)
+	: name(gaugeName), help(description), value(0.0)
+{
+}
+
+void MetricGauge::Set(double newValue)
+{
+	value.store(newValue, std::memory_order_relaxed);
+}
+
+MetricHistogram::MetricHistogram(const char* histogramName, const char* description, const std::vector<double> &upperBounds)
+	: name(histogramName), help(description), bounds(upperBounds), buckets(new std::atomic<unsigned long long>[upperBounds.size() + 1]), sum(0.0)
+{
+	for (size_t i = 0; i <= bounds.size(); ++i)
+	{
+		buckets[i].store(0);
+	}
+}
+
+void MetricHistogram::Observe(double measurement)
+{
+	//A handful of buckets, so a linear search is as fast as any
+	size_t bucket = 0;
+	while (bucket < bounds.size() && measurement > bounds[bucket]) ++bucket;
+
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	AtomicAdd(sum, measurement);
+}
+
+std::string MetricsRegistry::Format() const
+{
+	std::string out;
+
+	for (size_t i = 0; i < counters.size(); ++i)
+	{
+		AppendHeader(out, counters[i]->name, counters[i]->help, "counter");
+		out += counters[i]->name + " " + FormatValue(counters[i]->value.load(std::memory_order_relaxed)) + "\n";
+	}
+
+	for (size_t i = 0; i < gauges.size(); ++i)
+	{
+		AppendHeader(out, gauges[i]->name, gauges[i]->help, "gauge");
+		out += gauges[i]->name + " " + FormatValue(gauges[i]->value.load(std::memory_order_relaxed)) + "\n";
+	}
+
+	for (size_t i = 0; i < histograms.size(); ++i)
+	{
+		const MetricHistogram &histogram = *histograms[i];
+		AppendHeader(out, histogram.name, histogram.help, "histogram");
+
+		//Buckets are cumulative in the text format
+		unsigned long long count = 0;
+		for (size_t b = 0; b <= histogram.bounds.size(); ++b)
+		{
+			count += histogram.buckets[b].load(std::memory_order_relaxed);
+			std::string bound = b < histogram.bounds.size() ? FormatValue(histogram.bounds[b]) : "+Inf";
+			out += histogram.name + "_bucket{le=\"" + bound + "\"} " + FormatValue((double)count) + "\n";
+		}
+		out += histogram.name + "_sum " + FormatValue(histogram.sum.load(std::memory_order_relaxed)) + "\n";
+		out += histogram.name + "_count " + FormatValue((double)count) + "\n";
+	}
+
+	return out;
+}
+
+bool MetricsRegistry::WriteFile(const char* path) const
+{
+	std::string text = Format();
+	std::string temporary = std::string(path) + ".tmp";
+
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (file == nullptr) return false;
+	bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+	if (fclose(file) != 0) ok = false;
+
+#ifdef _WIN32
+	//rename does not replace on Windows
+	if (ok) remove(path);
+#endif
+	if (ok) ok = rename(temporary.c_str(), path) == 0;
+	if (!ok) remove(temporary.c_str());
+	return ok;
+}
+
+SimulationMetrics::SimulationMetrics()
+	: steps("massspring_steps_total", "Physics steps taken"),
+	frames("massspring_frames_total", "Batches of physics steps run to catch up with real time"),
+	simulatedSeconds("massspring_simulated_seconds_total", "Simulated time advanced"),
+	droppedSeconds("massspring_dropped_seconds_total", "Real time discarded by the catch-up clamp instead of being simulated"),
+	clamps("massspring_clamps_total", "Batches whose elapsed time was clamped"),
+	lagSeconds("massspring_lag_seconds", "Real time not yet simulated after the last batch"),
+	substeps("massspring_substeps", "Physics steps per batch", { 0, 1, 2, 3, 4, 6, 8, 12, 16, 24, 32 }),
+	stepSeconds("massspring_step_seconds", "Wall time of each physics step",
+		{ 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25 }),
+	uploadSeconds("massspring_upload_seconds", "Wall time of each frame's vertex upload",
+		{ 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025 })
+{
+	registry.Add(steps);
+	registry.Add(frames);
+	registry.Add(simulatedSeconds);
+	registry.Add(droppedSeconds);
+	registry.Add(clamps);
+	registry.Add(lagSeconds);
+	registry.Add(substeps);
+	registry.Add(stepSeconds);
+	registry.Add(uploadSeconds);
+}
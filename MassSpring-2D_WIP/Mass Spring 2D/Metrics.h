@@ -0,0 +1,127 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+//Counters, gauges and histograms describing how the simulation keeps up with real time.
+//
+//Every update is a handful of relaxed atomic operations, so they may be recorded from any thread at
+//every step. A MetricsRegistry formats the metrics it holds in the Prometheus text exposition format,
+//which MetricsExporter writes to a file or serves over HTTP.
+
+//A value that only goes up, such as the number of steps taken
+struct MetricCounter
+{
+	std::string name;
+	std::string help;
+	std::atomic<double> value;
+
+	///
+	//Parameterized constructor, starts at zero
+	//
+	//Parameters:
+	//	counterName: The Prometheus name, ending in _total by convention
+	//	description: The help text
+	MetricCounter(const char* counterName, const char* description);
+
+	///
+	//Increases the counter
+	//
+	//Parameters:
+	//	amount: How much to add, never negative
+	void Add(double amount);
+};
+
+//A value that goes up and down, such as how far the simulation lags behind real time
+struct MetricGauge
+{
+	std::string name;
+	std::string help;
+	std::atomic<double> value;
+
+	///
+	//Parameterized constructor, starts at zero
+	//
+	//Parameters:
+	//	gaugeName: The Prometheus name
+	//	description: The help text
+	MetricGauge(const char* gaugeName, const char* description);
+
+	///
+	//Replaces the value
+	void Set(double newValue);
+};
+
+//The distribution of a measurement, counted into buckets with fixed upper bounds
+struct MetricHistogram
+{
+	std::string name;
+	std::string help;
+	std::vector<double> bounds;							//The upper bound of each bucket, increasing
+	std::unique_ptr<std::atomic<unsigned long long>[]> buckets;	//One per bound, then one for larger values
+	std::atomic<double> sum;
+
+	///
+	//Parameterized constructor, starts empty
+	//
+	//Parameters:
+	//	histogramName: The Prometheus name
+	//	description: The help text
+	//	upperBounds: The upper bound of each bucket, increasing
+	MetricHistogram(const char* histogramName, const char* description, const std::vector<double> &upperBounds);
+
+	///
+	//Counts a measurement into its bucket
+	void Observe(double measurement);
+};
+
+//The metrics to export together. Does not own them; they must outlive the registry.
+struct MetricsRegistry
+{
+	std::vector<MetricCounter*> counters;
+	std::vector<MetricGauge*> gauges;
+	std::vector<MetricHistogram*> histograms;
+
+	void Add(MetricCounter &counter) { counters.push_back(&counter); }
+	void Add(MetricGauge &gauge) { gauges.push_back(&gauge); }
+	void Add(MetricHistogram &histogram) { histograms.push_back(&histogram); }
+
+	///
+	//Returns the current value of every metric in the Prometheus text format
+	std::string Format() const;
+
+	///
+	//Writes Format to a file, replacing it in one step so a reader never sees half of it
+	//
+	//Parameters:
+	//	path: The file to write
+	//
+	//Returns:
+	//	False if the file could not be written
+	bool WriteFile(const char* path) const;
+};
+
+//The metrics the solver front ends record
+struct SimulationMetrics
+{
+	MetricCounter steps;				//Physics steps taken
+	MetricCounter frames;				//Batches of steps run to catch up with real time
+	MetricCounter simulatedSeconds;		//Simulated time advanced
+	MetricCounter droppedSeconds;		//Real time discarded by the catch-up clamp, never simulated
+	MetricCounter clamps;				//Batches whose time was clamped
+	MetricGauge lagSeconds;				//Real time not yet simulated after the last batch
+	MetricHistogram substeps;			//Steps per batch
+	MetricHistogram stepSeconds;		//Wall time of each step
+	MetricHistogram uploadSeconds;		//Wall time of each frame's vertex upload
+
+	MetricsRegistry registry;			//All of the above
+
+	///
+	//Default constructor, registers every metric
+	SimulationMetrics();
+};
+
+#endif //_METRICS_H
@@ -0,0 +1,207 @@
+/*
+Metrics exporter
+
+The HTTP side is the smallest server Prometheus can scrape: one connection at a time, the request line
+is read and anything after it ignored, and every response closes the connection. The listening socket
+is polled with a short timeout, so the same thread also keeps the file up to date and notices Stop.
+*/
+
+#include "MetricsExporter.h"
+
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET SocketHandle;
+#define CloseSocket closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SocketHandle;
+#define CloseSocket close
+#endif
+
+//A client hanging up mid-response must not raise SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define METRICS_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define METRICS_SEND_FLAGS 0
+#endif
+
+//How long the thread waits for a connection before checking the file and Stop, in milliseconds
+#define METRICS_POLL_MS 100
+
+MetricsExporter::MetricsExporter()
+{
+	registry = nullptr;
+	interval = 1.0;
+	listener = -1;
+	running.store(false);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+	Stop();
+}
+
+bool MetricsExporter::Start(const MetricsRegistry &metrics, const char* file, int port, double seconds)
+{
+	Stop();
+
+	registry = &metrics;
+	path = file != nullptr ? file : "";
+	interval = seconds;
+
+	if (port > 0)
+	{
+#ifdef _WIN32
+		WSADATA data;
+		if (WSAStartup(MAKEWORD(2, 2), &data) != 0) return false;
+#endif
+		SocketHandle socketHandle = socket(AF_INET, SOCK_STREAM, 0);
+		bool bound = socketHandle != (SocketHandle)-1;
+
+		if (bound)
+		{
+			int reuse = 1;
+			setsockopt(socketHandle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+			sockaddr_in address;
+			memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_port = htons((unsigned short)port);
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+			bound = bind(socketHandle, (sockaddr*)&address, sizeof(address)) == 0 && listen(socketHandle, 4) == 0;
+			if (!bound) CloseSocket(socketHandle);
+		}
+
+		if (!bound)
+		{
+#ifdef _WIN32
+			WSACleanup();
+#endif
+			return false;
+		}
+		listener = (intptr_t)socketHandle;
+	}
+
+	running.store(true);
+	thread = std::thread(&MetricsExporter::Loop, this);
+	return true;
+}
+
+bool MetricsExporter::Stop()
+{
+	if (!running.load()) return true;
+
+	running.store(false);
+	thread.join();
+
+	if (listener != -1)
+	{
+		CloseSocket((SocketHandle)listener);
+		listener = -1;
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+
+	return path.empty() || registry->WriteFile(path.c_str());
+}
+
+void MetricsExporter::Loop()
+{
+	std::chrono::steady_clock::time_point nextWrite = std::chrono::steady_clock::now();
+
+	while (running.load())
+	{
+		if (!path.empty() && std::chrono::steady_clock::now() >= nextWrite)
+		{
+			registry->WriteFile(path.c_str());
+			nextWrite += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+		}
+
+		if (listener == -1)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(METRICS_POLL_MS));
+			continue;
+		}
+
+		SocketHandle socketHandle = (SocketHandle)listener;
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(socketHandle, &readable);
+		timeval timeout;
+		timeout.tv_sec = 0;
+		timeout.tv_usec = METRICS_POLL_MS * 1000;
+
+		if (select((int)socketHandle + 1, &readable, nullptr, nullptr, &timeout) > 0)
+		{
+			SocketHandle connection = accept(socketHandle, nullptr, nullptr);
+			if (connection != (SocketHandle)-1) Serve((intptr_t)connection);
+		}
+	}
+}
+
+void MetricsExporter::Serve(intptr_t connection)
+{
+	SocketHandle socketHandle = (SocketHandle)connection;
+
+	//A slow or silent client must not stall the exporter
+#ifdef _WIN32
+	DWORD wait = 1000;
+#else
+	timeval wait;
+	wait.tv_sec = 1;
+	wait.tv_usec = 0;
+#endif
+	setsockopt(socketHandle, SOL_SOCKET, SO_RCVTIMEO, (const char*)&wait, sizeof(wait));
+	setsockopt(socketHandle, SOL_SOCKET, SO_SNDTIMEO, (const char*)&wait, sizeof(wait));
+
+	//Only the request line matters
+	char request[1024];
+	int received = 0;
+	while (received < (int)sizeof(request) - 1)
+	{
+		int bytes = (int)recv(socketHandle, request + received, (int)sizeof(request) - 1 - received, 0);
+		if (bytes <= 0) break;
+		received += bytes;
+		request[received] = '\0';
+		if (strstr(request, "\r\n") != nullptr) break;
+	}
+	request[received] = '\0';
+
+	std::string body;
+	const char* status;
+	if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0)
+	{
+		status = "200 OK";
+		body = registry->Format();
+	}
+	else
+	{
+		status = "404 Not Found";
+		body = "Not found\n";
+	}
+
+	std::string response = std::string("HTTP/1.0 ") + status + "\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: " + std::to_string(body.size()) + "\r\n"
+		"Connection: close\r\n\r\n" + body;
+
+	size_t sent = 0;
+	while (sent < response.size())
+	{
+		int bytes = (int)send(socketHandle, response.data() + sent, (int)(response.size() - sent), METRICS_SEND_FLAGS);
+		if (bytes <= 0) break;
+		sent += bytes;
+	}
+
+	CloseSocket(socketHandle);
+}
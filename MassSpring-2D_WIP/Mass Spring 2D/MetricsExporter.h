@@ -0,0 +1,56 @@
+#ifndef _METRICS_EXPORTER_H
+#define _METRICS_EXPORTER_H
+
+#include "Metrics.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+//Publishes a MetricsRegistry from a background thread: rewrites a file every interval, and/or answers
+//HTTP GET requests for /metrics on 127.0.0.1 so a Prometheus server on the same machine can scrape it.
+//Only the loopback interface is bound; the endpoint is not reachable from other machines.
+struct MetricsExporter
+{
+	const MetricsRegistry* registry;
+	std::string path;					//The file to rewrite, empty for none
+	double interval;					//Seconds between file writes
+	intptr_t listener;					//The listening socket, -1 for none
+	std::thread thread;
+	std::atomic<bool> running;
+
+	///
+	//Default constructor, exports nothing until Start is called
+	MetricsExporter();
+	~MetricsExporter();
+
+	///
+	//Starts exporting
+	//
+	//Parameters:
+	//	metrics: The metrics to export, which must outlive the exporter
+	//	file: The file to rewrite every interval, or nullptr for none
+	//	port: The localhost port to serve /metrics on, or 0 for none
+	//	seconds: The time between file writes
+	//
+	//Returns:
+	//	False if the port could not be bound
+	bool Start(const MetricsRegistry &metrics, const char* file, int port, double seconds);
+
+	///
+	//Stops the thread, writing the file one last time so it holds the final values
+	//
+	//Returns:
+	//	False if the last write failed
+	bool Stop();
+
+	///
+	//The exporter thread: writes the file and answers requests until stopped
+	void Loop();
+
+	///
+	//Answers one HTTP request on an accepted connection, then closes it
+	void Serve(intptr_t connection);
+};
+
+#endif //_METRICS_EXPORTER_H
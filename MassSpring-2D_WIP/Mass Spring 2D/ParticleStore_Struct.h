@@ -0,0 +1,156 @@
+#ifndef _PARTICLESTORE_STRUCT_H
+#define _PARTICLESTORE_STRUCT_H
+
+#include "Arena_Struct.h"
+
+//Structure-of-arrays storage for the point masses of a softbody.
+//Each attribute is kept in its own contiguous, cache line aligned array so that a loop
+//which only needs positions only streams positions. The system is 2D, so no z is stored.
+struct ParticleStore
+{
+	unsigned int count;		//The number of particles in the store
+
+	float* x;				//Positions
+	float* y;
+	float* vx;				//Velocities
+	float* vy;
+	float* fx;				//Net forces accumulated over the current step
+	float* fy;
+	float* invMass;			//Inverse masses (0.0f for infinite mass)
+
+	bool borrowed;			//Whether the position, velocity and mass arrays belong to someone else,
+							//such as a memory mapped snapshot or an arena, and must not be freed
+	bool forcesBorrowed;	//Whether the net force arrays belong to someone else too
+
+	///
+	//Default constructor, creates an empty store
+	ParticleStore()
+	{
+		count = 0;
+		x = y = vx = vy = fx = fy = invMass = nullptr;
+		borrowed = forcesBorrowed = false;
+	}
+
+	///
+	//Allocates zeroed arrays for the given number of particles, releasing any previous ones
+	//
+	//Parameters:
+	//	n: The number of particles
+	void Allocate(unsigned int n)
+	{
+		Release();
+		count = n;
+
+		size_t size = sizeof(float) * n;
+		x = (float*)AlignedAlloc(size);
+		y = (float*)AlignedAlloc(size);
+		vx = (float*)AlignedAlloc(size);
+		vy = (float*)AlignedAlloc(size);
+		fx = (float*)AlignedAlloc(size);
+		fy = (float*)AlignedAlloc(size);
+		invMass = (float*)AlignedAlloc(size);
+	}
+
+	///
+	//Takes zeroed arrays for the given number of particles from an arena, releasing any previous ones.
+	//The arena owns them, so the store never frees them.
+	//
+	//Parameters:
+	//	n: The number of particles
+	//	arena: The arena to take the arrays from, with room for ArenaSize(n) more bytes
+	void Allocate(unsigned int n, Arena &arena)
+	{
+		Release();
+		count = n;
+		borrowed = forcesBorrowed = true;
+
+		size_t size = sizeof(float) * n;
+		x = (float*)arena.Take(size);
+		y = (float*)arena.Take(size);
+		vx = (float*)arena.Take(size);
+		vy = (float*)arena.Take(size);
+		fx = (float*)arena.Take(size);
+		fy = (float*)arena.Take(size);
+		invMass = (float*)arena.Take(size);
+	}
+
+	///
+	//Returns the bytes Allocate takes from an arena for the given number of particles
+	static size_t ArenaSize(unsigned int n)
+	{
+		return 7 * Arena::Footprint(sizeof(float) * n);
+	}
+
+	///
+	//Points the store at existing position, velocity and mass arrays without copying them, releasing
+	//any previous ones. The arrays must be cache line aligned and outlive the store.
+	//Zeroed net force arrays are allocated as usual.
+	//
+	//Parameters:
+	//	n: The number of particles
+	//	px, py: Positions
+	//	pvx, pvy: Velocities
+	//	pInvMass: Inverse masses
+	void Borrow(unsigned int n, float* px, float* py, float* pvx, float* pvy, float* pInvMass)
+	{
+		Release();
+		count = n;
+		borrowed = true;
+
+		x = px;
+		y = py;
+		vx = pvx;
+		vy = pvy;
+		invMass = pInvMass;
+		fx = (float*)AlignedAlloc(sizeof(float) * n);
+		fy = (float*)AlignedAlloc(sizeof(float) * n);
+	}
+
+	///
+	//Points the store at a range of another store's arrays, net forces included, without copying them,
+	//releasing any previous ones. Changes through either store are seen by both.
+	//
+	//Parameters:
+	//	source: The store to borrow from, which must outlive this one
+	//	first: The index in source of this store's first particle, a multiple of 16 to keep the arrays cache line aligned
+	//	n: The number of particles
+	void Borrow(const ParticleStore &source, unsigned int first, unsigned int n)
+	{
+		Release();
+		count = n;
+		borrowed = forcesBorrowed = true;
+
+		x = source.x + first;
+		y = source.y + first;
+		vx = source.vx + first;
+		vy = source.vy + first;
+		fx = source.fx + first;
+		fy = source.fy + first;
+		invMass = source.invMass + first;
+	}
+
+	///
+	//Frees all arrays the store owns
+	void Release()
+	{
+		if (!borrowed)
+		{
+			AlignedFree(x);
+			AlignedFree(y);
+			AlignedFree(vx);
+			AlignedFree(vy);
+			AlignedFree(invMass);
+		}
+		if (!forcesBorrowed)
+		{
+			AlignedFree(fx);
+			AlignedFree(fy);
+		}
+
+		count = 0;
+		x = y = vx = vy = fx = fy = invMass = nullptr;
+		borrowed = forcesBorrowed = false;
+	}
+};
+
+#endif //_PARTICLESTORE_STRUCT_H
@@ -0,0 +1,155 @@
+/*
+Profiler
+
+Each ring has a single writer, its thread, which fills the slot at head and then publishes it by
+incrementing head with release ordering. A reader copies the slots below head, then reads head again:
+any slot the writer may have started overwriting in the meantime held a zone no newer than the new head
+minus the ring size, and such zones are dropped rather than reported torn.
+
+The rings are registered under a mutex the first time each thread records, and are never freed, so a
+reader can walk them at any time. Threads that exit leave their zones behind for the trace.
+*/
+
+#include "Profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> profilerEnabled(false);
+
+static const std::chrono::steady_clock::time_point profilerEpoch = std::chrono::steady_clock::now();
+
+static std::mutex ringsMutex;
+static std::vector<ProfileRing*> rings;
+static thread_local ProfileRing* threadRing = nullptr;
+static thread_local char threadName[32] = "";	//Kept until the thread's ring exists
+
+///
+//Returns the calling thread's ring, creating it on first use
+static ProfileRing* GetThreadRing()
+{
+	if (threadRing == nullptr)
+	{
+		ProfileRing* ring = new ProfileRing;
+		ring->head.store(0);
+
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		ring->threadIndex = (int)rings.size() + 1;
+		if (threadName[0] != '\0') memcpy(ring->threadName, threadName, sizeof(ring->threadName));
+		else snprintf(ring->threadName, sizeof(ring->threadName), "Thread %d", ring->threadIndex);
+		rings.push_back(ring);
+		threadRing = ring;
+	}
+	return threadRing;
+}
+
+void ProfilerEnable(bool enable)
+{
+	profilerEnabled.store(enable);
+}
+
+uint64_t ProfilerNow()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profilerEpoch).count();
+}
+
+void ProfilerRecord(const char* name, uint64_t start, uint64_t end)
+{
+	ProfileRing* ring = GetThreadRing();
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+
+	ProfileEvent &event = ring->events[head & (PROFILE_RING_EVENTS - 1)];
+	event.name = name;
+	event.start = start;
+	event.duration = end - start;
+
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void ProfilerSetThreadName(const char* name)
+{
+	//Naming a thread does not create its ring, so threads that never record cost nothing
+	snprintf(threadName, sizeof(threadName), "%s", name);
+	if (threadRing != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		memcpy(threadRing->threadName, threadName, sizeof(threadRing->threadName));
+	}
+}
+
+///
+//Writes a string as a JSON string literal
+//
+//Parameters:
+//	file: The file to write to
+//	text: The string
+static void WriteJSONString(FILE* file, const char* text)
+{
+	fputc('"', file);
+	for (; *text != '\0'; ++text)
+	{
+		unsigned char c = (unsigned char)*text;
+		if (c == '"' || c == '\\') fprintf(file, "\\%c", c);
+		else if (c < 0x20) fprintf(file, "\\u%04x", c);
+		else fputc(c, file);
+	}
+	fputc('"', file);
+}
+
+bool ProfilerWriteTrace(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == nullptr) return false;
+
+	std::vector<ProfileRing*> snapshot;
+	{
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		snapshot = rings;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	std::vector<ProfileEvent> events;
+	for (size_t r = 0; r < snapshot.size(); ++r)
+	{
+		ProfileRing* ring = snapshot[r];
+
+		char name[sizeof(ring->threadName)];
+		{
+			std::lock_guard<std::mutex> lock(ringsMutex);
+			memcpy(name, ring->threadName, sizeof(name));
+		}
+		fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", ring->threadIndex);
+		WriteJSONString(file, name);
+		fprintf(file, "}}");
+		first = false;
+
+		//Copy first, then keep only what the writer cannot have touched since
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		uint64_t begin = head > PROFILE_RING_EVENTS ? head - PROFILE_RING_EVENTS : 0;
+		events.resize((size_t)(head - begin));
+		for (uint64_t i = begin; i < head; ++i)
+		{
+			events[(size_t)(i - begin)] = ring->events[i & (PROFILE_RING_EVENTS - 1)];
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		//The writer may be midway through the slot of zone number after, which held zone after - PROFILE_RING_EVENTS
+		uint64_t after = ring->head.load(std::memory_order_relaxed);
+		uint64_t valid = after + 1 > PROFILE_RING_EVENTS ? after + 1 - PROFILE_RING_EVENTS : 0;
+
+		for (uint64_t i = begin < valid ? valid : begin; i < head; ++i)
+		{
+			const ProfileEvent &event = events[(size_t)(i - begin)];
+			fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+				ring->threadIndex, event.start / 1000.0, event.duration / 1000.0);
+			WriteJSONString(file, event.name);
+			fputc('}', file);
+		}
+	}
+	fprintf(file, "\n]}\n");
+
+	return fclose(file) == 0;
+}
@@ -0,0 +1,104 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+
+//Scoped timers for the hot path, exported as a Chrome trace (chrome://tracing or ui.perfetto.dev).
+//
+//PROFILE_ZONE("name") times the rest of the enclosing scope. Each thread records into its own ring of
+//the last PROFILE_RING_EVENTS zones, so recording takes no lock and never allocates after a thread's
+//first zone; when a ring is full the oldest zones are overwritten. Recording is off until
+//ProfilerEnable is called, and then costs two clock reads per zone. Building without
+//MASSSPRING_PROFILING compiles the zones out entirely.
+//
+//Zone names must be string literals or otherwise outlive the profiler; only the pointer is stored.
+
+//The number of zones each thread keeps, a power of two
+#define PROFILE_RING_EVENTS 65536
+
+//One timed zone
+struct ProfileEvent
+{
+	const char* name;
+	uint64_t start;			//Nanoseconds since the profiler started
+	uint64_t duration;		//Nanoseconds
+};
+
+//The zones recorded by one thread. Only that thread writes to it.
+struct ProfileRing
+{
+	ProfileEvent events[PROFILE_RING_EVENTS];
+	std::atomic<uint64_t> head;		//The number of zones ever recorded; the newest is at (head - 1) % PROFILE_RING_EVENTS
+	int threadIndex;				//Reported as the thread id, in order of each thread's first zone
+	char threadName[32];
+};
+
+//Whether zones are being recorded
+extern std::atomic<bool> profilerEnabled;
+
+///
+//Starts or stops recording zones
+void ProfilerEnable(bool enable);
+
+///
+//Returns the nanoseconds since the profiler started
+uint64_t ProfilerNow();
+
+///
+//Adds a finished zone to the calling thread's ring
+//
+//Parameters:
+//	name: The zone's name
+//	start: ProfilerNow when the zone began
+//	end: ProfilerNow when the zone ended
+void ProfilerRecord(const char* name, uint64_t start, uint64_t end);
+
+///
+//Names the calling thread in the trace. Threads that are not named are called "Thread N".
+//
+//Parameters:
+//	name: The name, truncated to 31 characters
+void ProfilerSetThreadName(const char* name);
+
+///
+//Writes every zone still held by the rings as Chrome trace_event JSON.
+//Safe to call while other threads record; zones they overwrite during the copy are left out.
+//
+//Parameters:
+//	path: The file to write
+//
+//Returns:
+//	False if the file could not be written
+bool ProfilerWriteTrace(const char* path);
+
+//Times the scope it is declared in
+struct ProfileScope
+{
+	const char* name;
+	uint64_t start;
+	bool active;
+
+	ProfileScope(const char* zoneName)
+	{
+		name = zoneName;
+		active = profilerEnabled.load(std::memory_order_relaxed);
+		start = active ? ProfilerNow() : 0;
+	}
+
+	~ProfileScope()
+	{
+		if (active) ProfilerRecord(name, start, ProfilerNow());
+	}
+};
+
+#define PROFILE_JOIN_IMPL(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_IMPL(a, b)
+
+#ifdef MASSSPRING_PROFILING
+#define PROFILE_ZONE(name) ProfileScope PROFILE_JOIN(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+#endif //_PROFILER_H
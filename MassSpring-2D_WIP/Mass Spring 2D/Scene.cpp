@@ -0,0 +1,265 @@
+/*
+Scene files
+
+Parsed in one pass, line by line. Every setting is checked as it is read so errors point at the
+right line; pins are checked once their lattice's size is known, at the end of the file.
+*/
+
+#include "Scene.h"
+
+#include <fstream>
+#include <sstream>
+
+///
+//Parses an integrator name
+//
+//Parameters:
+//	name: explicit, implicit or xpbd
+//	integrator: Set to the integrator named
+//
+//Returns:
+//	False if the name is not an integrator
+static bool ParseIntegrator(const std::string &name, int &integrator)
+{
+	if (name == "explicit") integrator = INTEGRATOR_EXPLICIT_EULER;
+	else if (name == "implicit") integrator = INTEGRATOR_IMPLICIT_EULER;
+	else if (name == "xpbd") integrator = INTEGRATOR_XPBD;
+	else return false;
+	return true;
+}
+
+bool LoadScene(const char* path, Scene &scene, std::string &error)
+{
+	std::ifstream file(path);
+	if (!file.good())
+	{
+		error = std::string("Can't read file: ") + path;
+		return false;
+	}
+
+	scene = Scene();
+	SceneLattice* lattice = nullptr;
+
+	std::string line;
+	int number = 0;
+	while (std::getline(file, line))
+	{
+		++number;
+		std::string where = std::string(path) + ":" + std::to_string(number) + ": ";
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) line.erase(comment);
+
+		std::istringstream words(line);
+		std::string key;
+		if (!(words >> key)) continue;
+
+		//A scene-wide setting inside a lattice would silently change every lattice, not just that one
+		bool sceneWide = key == "step" || key == "adaptive" || key == "adaptive-tolerance" || key == "threads" ||
+			key == "deterministic" || key == "huge-pages" || key == "cg-iterations" || key == "cg-tolerance" ||
+			key == "xpbd-iterations" || key == "collide" || key == "sleep" || key == "sleep-steps";
+		if (sceneWide && lattice != nullptr)
+		{
+			error = where + "\"" + key + "\" must come before the first lattice";
+			return false;
+		}
+
+		bool ok = true;
+		bool lattices = false;	//Whether the setting belongs to a lattice
+		if (key == "lattice")
+		{
+			scene.lattices.push_back(SceneLattice());
+			lattice = &scene.lattices.back();
+		}
+		else if (key == "step")
+		{
+			ok = (words >> scene.physicsStep) && scene.physicsStep > 0.0f;
+		}
+		else if (key == "adaptive")
+		{
+			ok = (words >> scene.adaptiveMinStep >> scene.adaptiveMaxStep) &&
+				((scene.adaptiveMinStep == 0.0f && scene.adaptiveMaxStep == 0.0f) ||
+				(scene.adaptiveMinStep > 0.0f && scene.adaptiveMinStep <= scene.adaptiveMaxStep));
+		}
+		else if (key == "adaptive-tolerance")
+		{
+			ok = (words >> scene.adaptiveTolerance) && scene.adaptiveTolerance > 0.0f;
+		}
+		else if (key == "threads")
+		{
+			ok = (words >> scene.threads) && scene.threads >= 0;
+		}
+		else if (key == "deterministic")
+		{
+			int enabled = 0;
+			ok = (words >> enabled) && (enabled == 0 || enabled == 1);
+			scene.deterministic = enabled == 1;
+		}
+		else if (key == "huge-pages")
+		{
+			int enabled = 0;
+			ok = (words >> enabled) && (enabled == 0 || enabled == 1);
+			scene.hugePages = enabled == 1;
+		}
+		else if (key == "integrator")
+		{
+			std::string name;
+			int integrator = 0;
+			ok = (words >> name) && ParseIntegrator(name, integrator);
+			if (ok && lattice != nullptr) lattice->integrator = integrator;
+			else if (ok) scene.integrator = (IntegratorType)integrator;
+		}
+		else if (key == "cg-iterations")
+		{
+			ok = (words >> scene.cgMaxIterations) && scene.cgMaxIterations > 0;
+		}
+		else if (key == "cg-tolerance")
+		{
+			ok = (words >> scene.cgTolerance) && scene.cgTolerance > 0.0f;
+		}
+		else if (key == "xpbd-iterations")
+		{
+			ok = (words >> scene.xpbdIterations) && scene.xpbdIterations > 0;
+		}
+		else if (key == "collide")
+		{
+			ok = (words >> scene.collisionRadius) && scene.collisionRadius >= 0.0f;
+		}
+		else if (key == "sleep")
+		{
+			ok = (words >> scene.sleepThreshold) && scene.sleepThreshold >= 0.0f;
+		}
+		else if (key == "sleep-steps")
+		{
+			ok = (words >> scene.sleepSteps) && scene.sleepSteps > 0;
+		}
+		else if (key == "size" || key == "extent" || key == "center" || key == "coefficient" || key == "dampening" ||
+			key == "pin" || key == "pin-row" || key == "pin-column")
+		{
+			lattices = true;
+			if (lattice == nullptr)
+			{
+				error = where + "\"" + key + "\" must follow a \"lattice\" line";
+				return false;
+			}
+
+			ScenePin pin;
+			pin.row = pin.column = -1;
+			if (key == "size") ok = (words >> lattice->sizeX >> lattice->sizeY) && lattice->sizeX >= 2 && lattice->sizeY >= 2;
+			else if (key == "extent") ok = (words >> lattice->extentX >> lattice->extentY) && lattice->extentX > 0.0f && lattice->extentY > 0.0f;
+			else if (key == "center") ok = (bool)(words >> lattice->centerX >> lattice->centerY);
+			else if (key == "coefficient") ok = (words >> lattice->coefficient) && lattice->coefficient >= 0.0f;
+			else if (key == "dampening") ok = (words >> lattice->dampening) && lattice->dampening >= 0.0f;
+			else if (key == "pin") ok = (words >> pin.row >> pin.column) && pin.row >= 0 && pin.column >= 0;
+			else if (key == "pin-row") ok = (words >> pin.row) && pin.row >= 0;
+			else ok = (words >> pin.column) && pin.column >= 0;
+
+			if (ok && key.compare(0, 3, "pin") == 0) lattice->pins.push_back(pin);
+		}
+		else
+		{
+			error = where + "Unknown setting \"" + key + "\"";
+			return false;
+		}
+
+		//Anything left over is as wrong as anything missing
+		std::string extra;
+		if (!ok || (words >> extra))
+		{
+			error = where + "Bad value for \"" + key + "\"" + (lattices ? " in lattice " + std::to_string(scene.lattices.size()) : "");
+			return false;
+		}
+	}
+
+	if (scene.lattices.empty())
+	{
+		error = std::string(path) + ": The scene has no lattices";
+		return false;
+	}
+
+	for (size_t l = 0; l < scene.lattices.size(); ++l)
+	{
+		const SceneLattice &checked = scene.lattices[l];
+		for (size_t p = 0; p < checked.pins.size(); ++p)
+		{
+			if (checked.pins[p].row >= checked.sizeY || checked.pins[p].column >= checked.sizeX)
+			{
+				error = std::string(path) + ": A pin is outside lattice " + std::to_string(l + 1);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+SoftBody* BuildSceneLattice(const SceneLattice &lattice)
+{
+	SoftBody* body = new SoftBody(lattice.extentX, lattice.extentY, lattice.sizeX, lattice.sizeY, lattice.coefficient, lattice.dampening);
+	ParticleStore &p = body->particles;
+	int width = lattice.sizeX;
+	int height = lattice.sizeY;
+
+	for (unsigned int i = 0; i < body->numParticles; ++i)
+	{
+		p.x[i] += lattice.centerX;
+		p.y[i] += lattice.centerY;
+	}
+
+	for (size_t n = 0; n < lattice.pins.size(); ++n)
+	{
+		const ScenePin &pin = lattice.pins[n];
+		int firstRow = pin.row < 0 ? 0 : pin.row;
+		int endRow = pin.row < 0 ? height : pin.row + 1;
+		int firstColumn = pin.column < 0 ? 0 : pin.column;
+		int endColumn = pin.column < 0 ? width : pin.column + 1;
+
+		for (int i = firstRow; i < endRow; ++i)
+		{
+			for (int j = firstColumn; j < endColumn; ++j)
+			{
+				p.invMass[i * width + j] = 0.0f;
+			}
+		}
+	}
+
+	return body;
+}
+
+void BuildSceneWorld(const Scene &scene, World &world)
+{
+	std::vector<const SoftBody*> sources;
+	for (size_t i = 0; i < scene.lattices.size(); ++i)
+	{
+		sources.push_back(BuildSceneLattice(scene.lattices[i]));
+	}
+
+	world.hugePages = scene.hugePages;
+	world.Pack(sources);
+
+	for (size_t i = 0; i < sources.size(); ++i)
+	{
+		world.bodies[i]->integrator = scene.lattices[i].integrator;
+		delete sources[i];
+	}
+}
+
+bool ConfigureSceneStepper(AdaptiveStepper &stepper, const Scene &scene)
+{
+	if (scene.adaptiveMaxStep <= 0.0f) return false;
+
+	stepper.Configure(scene.adaptiveMinStep, scene.adaptiveMaxStep, scene.adaptiveTolerance, scene.physicsStep);
+	return true;
+}
+
+void ConfigureSceneSolver(SoftBodySolver &solver, const Scene &scene)
+{
+	solver.integrator = scene.integrator;
+	solver.deterministic = scene.deterministic;
+	solver.cgMaxIterations = scene.cgMaxIterations;
+	solver.cgTolerance = scene.cgTolerance;
+	solver.xpbdIterations = scene.xpbdIterations;
+	solver.collisionRadius = scene.collisionRadius;
+	solver.sleepThreshold = scene.sleepThreshold;
+	solver.sleepSteps = scene.sleepSteps;
+}
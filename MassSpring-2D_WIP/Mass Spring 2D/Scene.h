@@ -0,0 +1,166 @@
+#ifndef _SCENE_H
+#define _SCENE_H
+
+#include "World.h"
+#include "AdaptiveStep.h"
+
+#include <string>
+#include <vector>
+
+//Scenes describe what to simulate so runs can be sized without recompiling.
+//
+//A scene file is plain text with one setting per line; '#' starts a comment. Settings before the
+//first "lattice" line apply to the whole scene, and each "lattice" line starts a new lattice which the
+//settings after it describe. Only the integrator may be set in both places; the other scene-wide
+//settings are rejected after the first lattice:
+//
+//	step 0.012              Physics timestep in seconds, or the first step of an adaptive run
+//	adaptive 0 0            Shortest and longest step for the adaptive controller to choose between,
+//	                        0 0 for fixed steps
+//	adaptive-tolerance 1e-4 Adaptive: largest position error allowed per step
+//	threads 0               Solver threads, 0 for one per hardware thread
+//	deterministic 0         1 for the same results on any number of threads, see SoftBodySolver
+//	huge-pages 0            1 to back the particles and springs with huge pages where the OS allows, see Arena
+//	integrator explicit     explicit, implicit or xpbd; inside a lattice, overrides the scene's
+//	cg-iterations 50        Implicit Euler: most conjugate gradient iterations per step
+//	cg-tolerance 1e-4       Implicit Euler: relative residual to stop the solve at
+//	xpbd-iterations 10      XPBD: constraint projections per step
+//	collide 0               Self-collision particle radius, 0 for none
+//	sleep 0                 Explicit Euler: mean kinetic energy per unit mass below which a tile of the
+//	                        lattice may sleep, 0 to never sleep
+//	sleep-steps 30          Explicit Euler: steps a tile must stay below it before it sleeps
+//
+//	lattice
+//	size 10 10              Number of point masses along X and Y
+//	extent 1 1              Physical width and height
+//	center 0 0              Where the middle of the lattice starts
+//	coefficient 25          Spring coefficient
+//	dampening 0.5           Dampening coefficient
+//	pin 9 0                 Give the mass at row 9, column 0 infinite mass; row 0 is the bottom
+//	pin-row 9               Pin a whole row
+//	pin-column 0            Pin a whole column
+
+//A pinned mass, or a whole row or column of them
+struct ScenePin
+{
+	int row;		//-1 for every row
+	int column;		//-1 for every column
+};
+
+//One lattice of a scene
+struct SceneLattice
+{
+	int sizeX;
+	int sizeY;
+	float extentX;
+	float extentY;
+	float centerX;
+	float centerY;
+	float coefficient;
+	float dampening;
+	int integrator;					//An IntegratorType, or -1 to use the scene's
+	std::vector<ScenePin> pins;
+
+	///
+	//Default constructor, describes the original 10x10 cloth
+	SceneLattice()
+	{
+		sizeX = sizeY = 10;
+		extentX = extentY = 1.0f;
+		centerX = centerY = 0.0f;
+		coefficient = 25.0f;
+		dampening = 0.5f;
+		integrator = -1;
+	}
+};
+
+//Everything a run simulates
+struct Scene
+{
+	float physicsStep;
+	float adaptiveMinStep;
+	float adaptiveMaxStep;
+	float adaptiveTolerance;
+	int threads;
+	bool deterministic;
+	bool hugePages;
+	IntegratorType integrator;
+	int cgMaxIterations;
+	float cgTolerance;
+	int xpbdIterations;
+	float collisionRadius;
+	float sleepThreshold;
+	int sleepSteps;
+	std::vector<SceneLattice> lattices;
+
+	///
+	//Default constructor, describes the settings without any lattices
+	Scene()
+	{
+		physicsStep = 0.012f;
+		adaptiveMinStep = adaptiveMaxStep = 0.0f;
+		adaptiveTolerance = 1e-4f;
+		threads = 0;
+		deterministic = false;
+		hugePages = false;
+		integrator = INTEGRATOR_EXPLICIT_EULER;
+		cgMaxIterations = 50;
+		cgTolerance = 1e-4f;
+		xpbdIterations = 10;
+		collisionRadius = 0.0f;
+		sleepThreshold = 0.0f;
+		sleepSteps = 30;
+	}
+};
+
+///
+//Parses a scene file
+//
+//Parameters:
+//	path: The file to read
+//	scene: Set to the scene described by the file
+//	error: Set to a description of the first problem found, with its line number
+//
+//Returns:
+//	False if the file could not be read or is not a valid scene
+bool LoadScene(const char* path, Scene &scene, std::string &error);
+
+///
+//Creates the softbody a scene lattice describes, moved to its center and with its pins applied
+//
+//Parameters:
+//	lattice: The lattice to build
+//
+//Returns:
+//	The new softbody, owned by the caller
+SoftBody* BuildSceneLattice(const SceneLattice &lattice);
+
+///
+//Builds every lattice of a scene and packs them into a world, with each lattice's integrator and the
+//scene's page setting
+//
+//Parameters:
+//	scene: The scene
+//	world: Set to the scene's lattices, replacing any bodies it held
+void BuildSceneWorld(const Scene &scene, World &world);
+
+///
+//Applies a scene's adaptive step settings to a stepper
+//
+//Parameters:
+//	stepper: The stepper to configure
+//	scene: The scene
+//
+//Returns:
+//	False if the scene takes fixed steps, leaving the stepper unchanged
+bool ConfigureSceneStepper(AdaptiveStepper &stepper, const Scene &scene);
+
+///
+//Applies a scene's solver settings to the solver of its world
+//
+//Parameters:
+//	solver: The solver to configure
+//	scene: The scene
+void ConfigureSceneSolver(SoftBodySolver &solver, const Scene &scene);
+
+#endif //_SCENE_H
@@ -0,0 +1,338 @@
+/*
+Sleeping
+
+An explicit Euler step with settled tiles skipped, see SleepSystem. Each step:
+	1. Wake the sleeping tiles next to a tile that moved in the last step, and the tiles along the
+	   bottom row if the external force changed; then mark the tiles whose springs must be solved
+	2. Solve the springs starting in active tiles, in bands of tile rows, then the springs crossing
+	   from one band into the next
+	3. Integrate the awake tiles and zero the forces the springs left on the sleeping ones, measure
+	   each awake tile's kinetic energy, and put the tiles that have been quiet long enough to sleep
+After self-collision, WakeCollidedTiles wakes every tile holding a particle that was pushed, so the
+next step integrates it rather than leaving it where the contact put it.
+
+A spring is solved if either end is awake, so an awake particle always feels every spring attached
+to it; a sleeping particle holds still and is an anchor for its awake neighbours. Consecutive active
+tiles are one run of springs, rows included, so a lattice that is fully awake is solved in as few
+kernel calls as without sleeping.
+
+Waking only looks at the energies of the last step, never at tiles woken in the same pass, and each
+band of tile rows measures its own tiles, so the result does not depend on the number of threads.
+*/
+
+#include "SoftBodySolver.h"
+#include "Profiler.h"
+
+///
+//Calls a function for every run of consecutive particles in flagged tiles, over a range of rows.
+//A run reaching the end of a row carries on into the next if that starts flagged, so a range of
+//rows that is entirely flagged is a single run.
+//
+//Parameters:
+//	sys: The tiles
+//	flags: Per tile: whether its particles are part of a run
+//	firstRow: The first row of particles
+//	endRow: One past the last row of particles
+//	fn: Called with the first particle of the run and one past the last
+template<typename Function>
+static void ForEachRun(const SleepSystem &sys, const unsigned char* flags, int firstRow, int endRow, Function fn)
+{
+	unsigned int first = 0;
+	unsigned int last = 0;
+
+	for (int row = firstRow; row < endRow; ++row)
+	{
+		const unsigned char* tileRow = flags + (row / SLEEP_TILE_SIZE) * sys.tilesX;
+		unsigned int rowStart = row * sys.width;
+
+		for (int tile = 0; tile < sys.tilesX; ++tile)
+		{
+			if (!tileRow[tile]) continue;
+
+			unsigned int begin = rowStart + tile * SLEEP_TILE_SIZE;
+			int endColumn = (tile + 1) * SLEEP_TILE_SIZE < sys.width ? (tile + 1) * SLEEP_TILE_SIZE : sys.width;
+			if (begin != last)
+			{
+				if (last > first) fn(first, last);
+				first = begin;
+			}
+			last = rowStart + endColumn;
+		}
+	}
+
+	if (last > first) fn(first, last);
+}
+
+///
+//Returns the first row of a tile row, or the row count for one past the last tile row
+static int TileRowStart(const SleepSystem &sys, int tileRow)
+{
+	int row = tileRow * SLEEP_TILE_SIZE;
+	return row < sys.height ? row : sys.height;
+}
+
+unsigned int PrepareSleep(SoftBody &body, SleepSystem &system, float externalX, float externalY, float threshold)
+{
+	SleepSystem &sys = system;
+	sys.Resize(body.subdivisionsX, body.subdivisionsY, body.particles.x);
+
+	bool externalChanged = externalX != sys.externalX || externalY != sys.externalY;
+	sys.externalX = externalX;
+	sys.externalY = externalY;
+
+	//Wake the tiles something disturbed. Only last step's energies are read, which waking does not change.
+	for (int ty = 0; ty < sys.tilesY; ++ty)
+	{
+		for (int tx = 0; tx < sys.tilesX; ++tx)
+		{
+			int t = ty * sys.tilesX + tx;
+			if (sys.awake[t]) continue;
+
+			bool wake = ty == 0 && externalChanged;
+			int neighbours[4][2] = { { tx - 1, ty }, { tx + 1, ty }, { tx, ty - 1 }, { tx, ty + 1 } };
+			for (int n = 0; n < 4 && !wake; ++n)
+			{
+				int nx = neighbours[n][0];
+				int ny = neighbours[n][1];
+				if (nx < 0 || ny < 0 || nx >= sys.tilesX || ny >= sys.tilesY) continue;
+				wake = sys.energy[ny * sys.tilesX + nx] > threshold * sys.TileParticles(nx, ny);
+			}
+
+			if (wake)
+			{
+				sys.awake[t] = 1;
+				sys.quietSteps[t] = 0;
+			}
+		}
+	}
+
+	//Springs only run right and up, so those of a tile reach at most the tiles to its right and above
+	sys.awakeTiles = 0;
+	for (int ty = 0; ty < sys.tilesY; ++ty)
+	{
+		for (int tx = 0; tx < sys.tilesX; ++tx)
+		{
+			int t = ty * sys.tilesX + tx;
+			bool right = tx + 1 < sys.tilesX && sys.awake[t + 1];
+			bool up = ty + 1 < sys.tilesY && sys.awake[t + sys.tilesX];
+			sys.active[t] = sys.awake[t] || right || up;
+			sys.awakeTiles += sys.awake[t];
+		}
+	}
+
+	return sys.awakeTiles;
+}
+
+void ApplyActiveSpringForces(SoftBody &body, const SleepSystem &system, SpringForceKernel kernel, int firstTileRow, int endTileRow)
+{
+	ParticleStore &p = body.particles;
+	SpringTable &springs = body.springs;
+	float damp = body.dampening;
+
+	int firstRow = TileRowStart(system, firstTileRow);
+	int endRow = TileRowStart(system, endTileRow);
+	unsigned int endParticle = endRow * body.subdivisionsX;
+
+	ForEachRun(system, system.active, firstRow, endRow, [&](unsigned int first, unsigned int last)
+	{
+		unsigned int begin = springs.LowerBound(first);
+		unsigned int end = springs.LowerBound(last);
+
+		kernel(p.x, p.y, springs, begin, end);
+
+		//As ApplySpringForces, the second end only if it is inside the band
+		for (unsigned int s = begin; s < end; ++s)
+		{
+			unsigned int a = springs.a[s];
+			unsigned int b = springs.b[s];
+			float sx = springs.forceX[s];
+			float sy = springs.forceY[s];
+
+			p.fx[a] += sx - p.vx[a] * damp;
+			p.fy[a] += sy - p.vy[a] * damp;
+
+			if (b < endParticle)
+			{
+				p.fx[b] += -sx - p.vx[b] * damp;
+				p.fy[b] += -sy - p.vy[b] * damp;
+			}
+		}
+	});
+}
+
+void ApplyActiveBoundarySpringForces(SoftBody &body, const SleepSystem &system, int firstTileRow, int endTileRow)
+{
+	ParticleStore &p = body.particles;
+	SpringTable &springs = body.springs;
+	float damp = body.dampening;
+
+	int firstRow = TileRowStart(system, firstTileRow);
+	int endRow = TileRowStart(system, endTileRow);
+	if (endRow <= firstRow) return;
+	unsigned int endParticle = endRow * body.subdivisionsX;
+
+	//Only the runs whose springs ApplyActiveSpringForces evaluated this step
+	ForEachRun(system, system.active, endRow - 1, endRow, [&](unsigned int first, unsigned int last)
+	{
+		unsigned int begin = springs.LowerBound(first);
+		unsigned int end = springs.LowerBound(last);
+
+		for (unsigned int s = begin; s < end; ++s)
+		{
+			unsigned int b = springs.b[s];
+			if (b >= endParticle)
+			{
+				p.fx[b] += -springs.forceX[s] - p.vx[b] * damp;
+				p.fy[b] += -springs.forceY[s] - p.vy[b] * damp;
+			}
+		}
+	});
+}
+
+void IntegrateAwake(float dt, SoftBody &body, SleepSystem &system, int firstTileRow, int endTileRow, float threshold, int sleepSteps)
+{
+	ParticleStore &p = body.particles;
+	SleepSystem &sys = system;
+	int width = body.subdivisionsX;
+
+	for (int ty = firstTileRow; ty < endTileRow; ++ty)
+	{
+		float* energy = sys.energy + ty * sys.tilesX;
+		const unsigned char* awake = sys.awake + ty * sys.tilesX;
+		for (int tx = 0; tx < sys.tilesX; ++tx) energy[tx] = 0.0f;
+
+		int firstRow = TileRowStart(sys, ty);
+		int endRow = TileRowStart(sys, ty + 1);
+
+		//Springs shared with awake tiles left forces on the sleeping ones, which they ignore
+		for (int row = firstRow; row < endRow; ++row)
+		{
+			for (int tx = 0; tx < sys.tilesX; ++tx)
+			{
+				if (awake[tx]) continue;
+				int endColumn = (tx + 1) * SLEEP_TILE_SIZE < width ? (tx + 1) * SLEEP_TILE_SIZE : width;
+				unsigned int begin = row * width + tx * SLEEP_TILE_SIZE;
+				memset(p.fx + begin, 0, sizeof(float) * (row * width + endColumn - begin));
+				memset(p.fy + begin, 0, sizeof(float) * (row * width + endColumn - begin));
+			}
+		}
+
+		ForEachRun(sys, sys.awake, firstRow, endRow, [&](unsigned int first, unsigned int last)
+		{
+			IntegrateLinear(dt, p, first, last);
+		});
+
+		//Kinetic energy per unit mass, so a heavy tile does not stay awake longer than a light one
+		for (int row = firstRow; row < endRow; ++row)
+		{
+			for (int tx = 0; tx < sys.tilesX; ++tx)
+			{
+				if (!awake[tx]) continue;
+				int endColumn = (tx + 1) * SLEEP_TILE_SIZE < width ? (tx + 1) * SLEEP_TILE_SIZE : width;
+				float tileEnergy = 0.0f;
+				for (unsigned int i = row * width + tx * SLEEP_TILE_SIZE; i < (unsigned int)(row * width + endColumn); ++i)
+				{
+					tileEnergy += p.vx[i] * p.vx[i] + p.vy[i] * p.vy[i];
+				}
+				energy[tx] += 0.5f * tileEnergy;
+			}
+		}
+
+		//Put the tiles that stayed quiet long enough to sleep
+		for (int tx = 0; tx < sys.tilesX; ++tx)
+		{
+			int t = ty * sys.tilesX + tx;
+			if (!sys.awake[t]) continue;
+
+			if (energy[tx] > threshold * sys.TileParticles(tx, ty))
+			{
+				sys.quietSteps[t] = 0;
+				continue;
+			}
+			if (++sys.quietSteps[t] < (unsigned int)sleepSteps) continue;
+
+			sys.awake[t] = 0;
+			energy[tx] = 0.0f;
+			int endColumn = (tx + 1) * SLEEP_TILE_SIZE < width ? (tx + 1) * SLEEP_TILE_SIZE : width;
+			for (int row = firstRow; row < endRow; ++row)
+			{
+				unsigned int begin = row * width + tx * SLEEP_TILE_SIZE;
+				memset(p.vx + begin, 0, sizeof(float) * (row * width + endColumn - begin));
+				memset(p.vy + begin, 0, sizeof(float) * (row * width + endColumn - begin));
+			}
+		}
+	}
+}
+
+unsigned int StepSleepingExplicitEuler(SoftBody &body, SleepSystem &system, ThreadPool &pool, int bands, SpringForceKernel kernel,
+	float dt, float externalX, float externalY, float threshold, int sleepSteps)
+{
+	SleepSystem &sys = system;
+	ParticleStore &p = body.particles;
+	int width = body.subdivisionsX;
+
+	unsigned int awakeTiles = PrepareSleep(body, sys, externalX, externalY, threshold);
+
+	//The bands are whole rows of tiles, so each tile's energy is summed by one thread
+	if (bands > sys.tilesY) bands = sys.tilesY;
+
+	{
+		PROFILE_ZONE("Spring forces");
+		pool.Run(bands, [&](int band)
+		{
+			PROFILE_ZONE("Spring forces band");
+			int firstTileRow, endTileRow;
+			ThreadPool::Partition(sys.tilesY, bands, band, firstTileRow, endTileRow);
+			ApplyActiveSpringForces(body, sys, kernel, firstTileRow, endTileRow);
+		});
+
+		pool.Run(bands, [&](int band)
+		{
+			PROFILE_ZONE("Boundary spring forces band");
+			int firstTileRow, endTileRow;
+			ThreadPool::Partition(sys.tilesY, bands, band, firstTileRow, endTileRow);
+			ApplyActiveBoundarySpringForces(body, sys, firstTileRow, endTileRow);
+		});
+	}
+
+	PROFILE_ZONE("Integrate");
+	pool.Run(bands, [&](int band)
+	{
+		PROFILE_ZONE("Integrate band");
+		int firstTileRow, endTileRow;
+		ThreadPool::Partition(sys.tilesY, bands, band, firstTileRow, endTileRow);
+
+		if (firstTileRow == 0)
+		{
+			for (int j = 0; j < width; ++j)
+			{
+				p.fx[j] += externalX;
+				p.fy[j] += externalY;
+			}
+		}
+
+		IntegrateAwake(dt, body, sys, firstTileRow, endTileRow, threshold, sleepSteps);
+	});
+
+	return awakeTiles;
+}
+
+void WakeCollidedTiles(const SoftBody &body, SleepSystem &system, const CollisionSystem &collision)
+{
+	SleepSystem &sys = system;
+	const CollisionSystem &col = collision;
+	if (col.contacts == 0 || sys.positions != body.particles.x || sys.width != body.subdivisionsX || sys.height != body.subdivisionsY) return;
+
+	//Run on one thread: many particles share a tile, and waking only ever sets flags, so the order does not matter
+	int width = sys.width;
+	for (unsigned int k = 0; k < col.numParticles; ++k)
+	{
+		if (col.dx[k] == 0.0f && col.dy[k] == 0.0f && col.dvx[k] == 0.0f && col.dvy[k] == 0.0f) continue;
+
+		unsigned int i = col.sorted[k];
+		int t = ((int)i / width / SLEEP_TILE_SIZE) * sys.tilesX + ((int)i % width) / SLEEP_TILE_SIZE;
+		if (sys.awake[t]) continue;
+		sys.awake[t] = 1;
+		sys.quietSteps[t] = 0;
+	}
+}
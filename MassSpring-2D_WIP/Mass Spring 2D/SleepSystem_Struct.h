@@ -0,0 +1,140 @@
+#ifndef _SLEEPSYSTEM_STRUCT_H
+#define _SLEEPSYSTEM_STRUCT_H
+
+#include "AlignedMemory.h"
+
+//The width and height of a sleep tile, in particles
+#define SLEEP_TILE_SIZE 16
+
+//Working storage for putting settled regions of a lattice to sleep.
+//The lattice is divided into square tiles of particles. A tile whose kinetic energy stays below the
+//threshold for long enough falls asleep: its velocities are zeroed and it is neither integrated nor
+//has its own springs solved until something wakes it, which is a neighbouring tile moving, a collision
+//pushing one of its particles, or a change of the external force for the tiles along the bottom row.
+struct SleepSystem
+{
+	int width;					//The lattice the tiles cover, in particles
+	int height;
+	const float* positions;		//The particle array the state was built for
+	int tilesX;					//The number of tiles along X and Y
+	int tilesY;
+
+	unsigned char* awake;		//Per tile: whether it is integrated
+	unsigned char* active;		//Per tile: whether its springs are solved, true if it or the tile to its right or above is awake
+	unsigned int* quietSteps;	//Per tile: the number of steps in a row its energy stayed below the threshold
+	float* energy;				//Per tile: the sum of half the squared speeds at the end of the last step, 0 while asleep
+
+	float externalX;			//The external force of the last step
+	float externalY;
+	unsigned int awakeTiles;	//The number of tiles awake in the last step
+
+	///
+	//Default constructor, creates an empty system
+	SleepSystem()
+	{
+		width = height = tilesX = tilesY = 0;
+		positions = nullptr;
+		awake = active = nullptr;
+		quietSteps = nullptr;
+		energy = nullptr;
+		externalX = externalY = 0.0f;
+		awakeTiles = 0;
+	}
+
+	~SleepSystem()
+	{
+		Release();
+	}
+
+	///
+	//Makes room for the tiles of a lattice, waking every tile. Does nothing if the system was last
+	//sized for the same particles, so tiles keep sleeping from one step to the next.
+	//
+	//Parameters:
+	//	latticeWidth: The number of particles along X
+	//	latticeHeight: The number of particles along Y
+	//	x: The lattice's particle x coordinates, which identify it
+	void Resize(int latticeWidth, int latticeHeight, const float* x)
+	{
+		if (latticeWidth == width && latticeHeight == height && x == positions) return;
+
+		Release();
+		width = latticeWidth;
+		height = latticeHeight;
+		positions = x;
+		tilesX = (width + SLEEP_TILE_SIZE - 1) / SLEEP_TILE_SIZE;
+		tilesY = (height + SLEEP_TILE_SIZE - 1) / SLEEP_TILE_SIZE;
+
+		size_t tiles = (size_t)tilesX * tilesY;
+		awake = (unsigned char*)AlignedAlloc(tiles);
+		active = (unsigned char*)AlignedAlloc(tiles);
+		quietSteps = (unsigned int*)AlignedAlloc(sizeof(unsigned int) * tiles);
+		energy = (float*)AlignedAlloc(sizeof(float) * tiles);
+		WakeAll();
+	}
+
+	///
+	//Wakes every tile, for when the particles were moved by something other than the solver
+	void WakeAll()
+	{
+		size_t tiles = (size_t)tilesX * tilesY;
+		memset(awake, 1, tiles);
+		memset(active, 1, tiles);
+		memset(quietSteps, 0, sizeof(unsigned int) * tiles);
+		awakeTiles = (unsigned int)tiles;
+	}
+
+	///
+	//Makes this system a copy of another, so a step can be taken again from the same sleep state
+	//
+	//Parameters:
+	//	source: The system to copy
+	void CopyState(const SleepSystem &source)
+	{
+		Resize(source.width, source.height, source.positions);
+
+		size_t tiles = (size_t)tilesX * tilesY;
+		if (tiles > 0)
+		{
+			memcpy(awake, source.awake, tiles);
+			memcpy(active, source.active, tiles);
+			memcpy(quietSteps, source.quietSteps, sizeof(unsigned int) * tiles);
+			memcpy(energy, source.energy, sizeof(float) * tiles);
+		}
+		externalX = source.externalX;
+		externalY = source.externalY;
+		awakeTiles = source.awakeTiles;
+	}
+
+	///
+	//Returns the number of particles in a tile; those along the top and right edges may be cut short
+	//
+	//Parameters:
+	//	tileX: The tile's column
+	//	tileY: The tile's row
+	int TileParticles(int tileX, int tileY) const
+	{
+		int columns = width - tileX * SLEEP_TILE_SIZE;
+		int rows = height - tileY * SLEEP_TILE_SIZE;
+		return (columns < SLEEP_TILE_SIZE ? columns : SLEEP_TILE_SIZE) * (rows < SLEEP_TILE_SIZE ? rows : SLEEP_TILE_SIZE);
+	}
+
+	///
+	//Frees all arrays
+	void Release()
+	{
+		AlignedFree(awake);
+		AlignedFree(active);
+		AlignedFree(quietSteps);
+		AlignedFree(energy);
+
+		awake = active = nullptr;
+		quietSteps = nullptr;
+		energy = nullptr;
+		width = height = tilesX = tilesY = 0;
+		positions = nullptr;
+		awakeTiles = 0;
+	}
+};
+
+#endif //_SLEEPSYSTEM_STRUCT_H
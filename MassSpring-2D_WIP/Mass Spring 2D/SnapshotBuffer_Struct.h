@@ -0,0 +1,100 @@
+#ifndef _SNAPSHOTBUFFER_STRUCT_H
+#define _SNAPSHOTBUFFER_STRUCT_H
+
+#include <atomic>
+
+#include "AlignedMemory.h"
+
+//A lock-free triple buffer for handing snapshots of the simulation from one producer thread to one
+//consumer thread. The producer always has a buffer to write and the consumer always has a complete
+//snapshot to read, so neither ever waits on the other; a snapshot the consumer never picked up is
+//simply overwritten by the next one.
+struct SnapshotBuffer
+{
+	unsigned int size;			//The number of floats in each snapshot
+	float* buffers[3];
+	double times[3];			//A timestamp the producer attaches to each snapshot
+
+	int writeIndex;				//Owned by the producer
+	int readIndex;				//Owned by the consumer
+	std::atomic<int> middle;	//The buffer between them, with SNAPSHOT_FRESH set if it holds an unread snapshot
+
+	static const int SNAPSHOT_FRESH = 4;
+
+	///
+	//Parameterized constructor, allocates three zeroed snapshots
+	//
+	//Parameters:
+	//	floats: The number of floats in each snapshot
+	SnapshotBuffer(unsigned int floats)
+	{
+		size = floats;
+		for (int i = 0; i < 3; ++i)
+		{
+			buffers[i] = (float*)AlignedAlloc(sizeof(float) * size);
+			times[i] = 0.0;
+		}
+
+		writeIndex = 0;
+		middle.store(1);
+		readIndex = 2;
+	}
+
+	~SnapshotBuffer()
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			AlignedFree(buffers[i]);
+		}
+	}
+
+	///
+	//Producer: returns the snapshot to write into
+	float* GetWriteBuffer()
+	{
+		return buffers[writeIndex];
+	}
+
+	///
+	//Producer: sets the timestamp of the snapshot being written
+	void SetWriteTime(double time)
+	{
+		times[writeIndex] = time;
+	}
+
+	///
+	//Producer: publishes the written snapshot and moves on to a free buffer
+	void Publish()
+	{
+		writeIndex = middle.exchange(writeIndex | SNAPSHOT_FRESH, std::memory_order_acq_rel) & 3;
+	}
+
+	///
+	//Consumer: picks up the newest published snapshot, if there is one
+	//
+	//Returns:
+	//	True if the read buffer now holds a snapshot not seen before
+	bool Acquire()
+	{
+		if ((middle.load(std::memory_order_acquire) & SNAPSHOT_FRESH) == 0) return false;
+
+		readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & 3;
+		return true;
+	}
+
+	///
+	//Consumer: returns the snapshot picked up by the last successful Acquire
+	const float* GetReadBuffer() const
+	{
+		return buffers[readIndex];
+	}
+
+	///
+	//Consumer: returns the timestamp of the snapshot picked up by the last successful Acquire
+	double GetReadTime() const
+	{
+		return times[readIndex];
+	}
+};
+
+#endif //_SNAPSHOTBUFFER_STRUCT_H
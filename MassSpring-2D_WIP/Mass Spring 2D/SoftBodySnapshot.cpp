@@ -0,0 +1,300 @@
+/*
+Softbody snapshots
+
+Saving streams the header and arrays through stdio into a temporary file next to the destination,
+then renames it over the destination. A run killed mid-save therefore never leaves a torn checkpoint,
+and a body still mapping the previous checkpoint at that path keeps reading the old file, which
+truncating it in place would have pulled from under it.
+
+On little-endian machines the arrays are written as they are; on big-endian machines every 32 bit
+word is swapped on the way out and on the way in, and loading falls back to copying into freshly
+allocated arrays.
+
+Loading checks the header and then every spring before the body gives up its state, so a corrupted
+file is rejected rather than handing the solvers an index outside the particles.
+*/
+
+#include "SoftBodySnapshot.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+static_assert(sizeof(SoftBodySnapshotHeader) == 128, "The snapshot header layout must not change within a version");
+
+///
+//Returns whether this machine stores integers little-endian
+static bool IsLittleEndian()
+{
+	uint32_t one = 1;
+	unsigned char first;
+	memcpy(&first, &one, 1);
+	return first == 1;
+}
+
+///
+//Reverses the bytes of each 32 bit word of an array
+//
+//Parameters:
+//	words: The array to swap in place
+//	count: The number of words
+static void SwapWords(void* words, size_t count)
+{
+	unsigned char* bytes = (unsigned char*)words;
+	for (size_t i = 0; i < count; ++i, bytes += 4)
+	{
+		unsigned char b0 = bytes[0], b1 = bytes[1];
+		bytes[0] = bytes[3];
+		bytes[1] = bytes[2];
+		bytes[2] = b1;
+		bytes[3] = b0;
+	}
+}
+
+///
+//Converts every field of a header between this machine's byte order and little-endian
+//
+//Parameters:
+//	header: The header to convert in place
+static void SwapHeader(SoftBodySnapshotHeader &header)
+{
+	if (IsLittleEndian()) return;
+
+	//Everything after the magic is 32 bit words, except the 64 bit offsets and size,
+	//whose two halves also trade places
+	SwapWords(&header.version, 10);
+	for (int i = 0; i < SNAPSHOT_NUM_ARRAYS + 1; ++i)
+	{
+		uint64_t &value = i < SNAPSHOT_NUM_ARRAYS ? header.offsets[i] : header.fileSize;
+		uint32_t halves[2];
+		memcpy(halves, &value, 8);
+		SwapWords(halves, 2);
+		uint32_t high = halves[0];
+		halves[0] = halves[1];
+		halves[1] = high;
+		memcpy(&value, halves, 8);
+	}
+}
+
+///
+//Reads a 32 bit word of an array stored little-endian
+//
+//Parameters:
+//	words: The array as stored in the file
+//	i: The index of the word
+static uint32_t ReadWord(const void* words, uint32_t i)
+{
+	uint32_t word;
+	memcpy(&word, (const unsigned char*)words + (size_t)i * 4, 4);
+	if (!IsLittleEndian()) SwapWords(&word, 1);
+	return word;
+}
+
+///
+//Checks the springs of a snapshot in one pass, so that no solver indexes outside the particles or
+//reads a rest length or stiffness it cannot step
+//
+//Parameters:
+//	header: The header of the snapshot, in this machine's byte order
+//	arrays: The arrays of the snapshot as stored in the file
+//
+//Returns:
+//	False unless every spring joins two different particles with a < b, the springs are ordered by
+//	their first particle, and every rest length and stiffness is finite and not negative
+static bool ValidSprings(const SoftBodySnapshotHeader &header, void* const arrays[SNAPSHOT_NUM_ARRAYS])
+{
+	uint32_t previous = 0;
+	for (uint32_t i = 0; i < header.numSprings; ++i)
+	{
+		uint32_t a = ReadWord(arrays[SNAPSHOT_SPRING_A], i);
+		uint32_t b = ReadWord(arrays[SNAPSHOT_SPRING_B], i);
+		if (a < previous || a >= b || b >= header.numParticles) return false;
+		previous = a;
+
+		uint32_t words[2] = { ReadWord(arrays[SNAPSHOT_REST_LENGTH], i), ReadWord(arrays[SNAPSHOT_STIFFNESS], i) };
+		float values[2];
+		memcpy(values, words, sizeof(values));
+		for (int v = 0; v < 2; ++v)
+		{
+			if (!std::isfinite(values[v]) || values[v] < 0.0f) return false;
+		}
+	}
+	return true;
+}
+
+///
+//Rounds a byte count up to a whole number of cache lines
+static uint64_t PadToCacheLine(uint64_t bytes)
+{
+	return (bytes + CACHE_LINE_SIZE - 1) & ~(uint64_t)(CACHE_LINE_SIZE - 1);
+}
+
+///
+//Writes an array of 32 bit words little-endian, followed by zeros up to the next cache line
+//
+//Parameters:
+//	file: The file to write to
+//	words: The array to write
+//	count: The number of words
+//
+//Returns:
+//	False if the write failed
+static bool WriteArray(FILE* file, const void* words, uint32_t count)
+{
+	static const unsigned char zeros[CACHE_LINE_SIZE] = { 0 };
+	size_t bytes = (size_t)count * 4;
+
+	if (IsLittleEndian())
+	{
+		if (count > 0 && fwrite(words, 1, bytes, file) != bytes) return false;
+	}
+	else
+	{
+		//Swap a chunk at a time rather than copying the whole array
+		uint32_t chunk[1024];
+		const uint32_t* source = (const uint32_t*)words;
+		for (uint32_t done = 0; done < count;)
+		{
+			uint32_t n = count - done < 1024 ? count - done : 1024;
+			memcpy(chunk, source + done, (size_t)n * 4);
+			SwapWords(chunk, n);
+			if (fwrite(chunk, 4, n, file) != n) return false;
+			done += n;
+		}
+	}
+
+	size_t padding = (size_t)(PadToCacheLine(bytes) - bytes);
+	return padding == 0 || fwrite(zeros, 1, padding, file) == padding;
+}
+
+bool SaveSoftBody(const SoftBody &body, const char* path)
+{
+	const ParticleStore &p = body.particles;
+	const SpringTable &springs = body.springs;
+
+	SoftBodySnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SOFTBODY_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version = SOFTBODY_SNAPSHOT_VERSION;
+	header.headerSize = sizeof(SoftBodySnapshotHeader);
+	header.subdivisionsX = body.subdivisionsX;
+	header.subdivisionsY = body.subdivisionsY;
+	header.restWidth = body.restWidth;
+	header.restHeight = body.restHeight;
+	header.coefficient = body.coefficient;
+	header.dampening = body.dampening;
+	header.numParticles = p.count;
+	header.numSprings = springs.count;
+
+	//Lay the arrays out one after another, each on its own cache line
+	const void* arrays[SNAPSHOT_NUM_ARRAYS] = { p.x, p.y, p.vx, p.vy, p.invMass, springs.a, springs.b, springs.restLength, springs.stiffness };
+	uint64_t offset = PadToCacheLine(sizeof(header));
+	for (int i = 0; i < SNAPSHOT_NUM_ARRAYS; ++i)
+	{
+		uint32_t count = i < SNAPSHOT_SPRING_A ? header.numParticles : header.numSprings;
+		header.offsets[i] = offset;
+		offset += PadToCacheLine((uint64_t)count * 4);
+	}
+	header.fileSize = offset;
+
+	std::string temporary = std::string(path) + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (file == nullptr) return false;
+
+	SoftBodySnapshotHeader stored = header;
+	SwapHeader(stored);
+	bool ok = fwrite(&stored, sizeof(stored), 1, file) == 1;
+
+	for (int i = 0; i < SNAPSHOT_NUM_ARRAYS && ok; ++i)
+	{
+		ok = WriteArray(file, arrays[i], i < SNAPSHOT_SPRING_A ? header.numParticles : header.numSprings);
+	}
+
+	if (fclose(file) != 0) ok = false;
+
+#ifdef _WIN32
+	//rename does not replace on Windows. This fails while the old file is still mapped.
+	if (ok) remove(path);
+#endif
+	if (ok) ok = rename(temporary.c_str(), path) == 0;
+	if (!ok) remove(temporary.c_str());
+	return ok;
+}
+
+bool LoadSoftBody(SoftBody &body, const char* path)
+{
+	MappedFile file;
+	if (!file.Open(path) || file.size < sizeof(SoftBodySnapshotHeader)) return false;
+
+	SoftBodySnapshotHeader header;
+	memcpy(&header, file.data, sizeof(header));
+	SwapHeader(header);
+
+	//Check everything the arrays will be pointed at by
+	if (memcmp(header.magic, SOFTBODY_SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) return false;
+	if (header.version != SOFTBODY_SNAPSHOT_VERSION || header.headerSize != sizeof(SoftBodySnapshotHeader)) return false;
+	if (header.fileSize != file.size) return false;
+	if (header.subdivisionsX < 1 || header.subdivisionsY < 1) return false;
+	if ((uint64_t)header.subdivisionsX * (uint64_t)header.subdivisionsY != header.numParticles) return false;
+
+	//The springs of a lattice, as SoftBody builds them
+	uint64_t subX = header.subdivisionsX, subY = header.subdivisionsY;
+	if ((subX - 1) * subY + subX * (subY - 1) != header.numSprings) return false;
+
+	unsigned char* base = (unsigned char*)file.data;
+	void* arrays[SNAPSHOT_NUM_ARRAYS];
+	for (int i = 0; i < SNAPSHOT_NUM_ARRAYS; ++i)
+	{
+		uint64_t bytes = (uint64_t)(i < SNAPSHOT_SPRING_A ? header.numParticles : header.numSprings) * 4;
+		uint64_t offset = header.offsets[i];
+		if (offset % CACHE_LINE_SIZE != 0 || offset < sizeof(header) || offset > file.size || bytes > file.size - offset) return false;
+		arrays[i] = base + offset;
+	}
+	if (!ValidSprings(header, arrays)) return false;
+
+	//The file is good, replace the body's state
+	body.particles.Release();
+	body.springs.Release();
+
+	body.subdivisionsX = header.subdivisionsX;
+	body.subdivisionsY = header.subdivisionsY;
+	body.restWidth = header.restWidth;
+	body.restHeight = header.restHeight;
+	body.coefficient = header.coefficient;
+	body.dampening = header.dampening;
+	body.numParticles = header.numParticles;
+
+	if (IsLittleEndian())
+	{
+		//Zero copy: the arrays live in the mapping, which the body takes over
+		body.particles.Borrow(header.numParticles,
+			(float*)arrays[SNAPSHOT_X], (float*)arrays[SNAPSHOT_Y],
+			(float*)arrays[SNAPSHOT_VX], (float*)arrays[SNAPSHOT_VY],
+			(float*)arrays[SNAPSHOT_INV_MASS]);
+		body.springs.Borrow(header.numSprings,
+			(unsigned int*)arrays[SNAPSHOT_SPRING_A], (unsigned int*)arrays[SNAPSHOT_SPRING_B],
+			(float*)arrays[SNAPSHOT_REST_LENGTH], (float*)arrays[SNAPSHOT_STIFFNESS]);
+		body.mapping.Swap(file);
+	}
+	else
+	{
+		//Copy into owned arrays, swapping them to this machine's byte order
+		body.particles.Allocate(header.numParticles);
+		body.springs.Allocate(header.numSprings);
+		body.springs.count = header.numSprings;
+
+		void* destinations[SNAPSHOT_NUM_ARRAYS] = {
+			body.particles.x, body.particles.y, body.particles.vx, body.particles.vy, body.particles.invMass,
+			body.springs.a, body.springs.b, body.springs.restLength, body.springs.stiffness };
+		for (int i = 0; i < SNAPSHOT_NUM_ARRAYS; ++i)
+		{
+			uint32_t count = i < SNAPSHOT_SPRING_A ? header.numParticles : header.numSprings;
+			memcpy(destinations[i], arrays[i], (size_t)count * 4);
+			SwapWords(destinations[i], count);
+		}
+		body.mapping.Close();
+	}
+
+	return true;
+}
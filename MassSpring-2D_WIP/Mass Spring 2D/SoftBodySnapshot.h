@@ -0,0 +1,88 @@
+#ifndef _SOFTBODY_SNAPSHOT_H
+#define _SOFTBODY_SNAPSHOT_H
+
+#include "SoftBody_Struct.h"
+
+#include <cstdint>
+
+//Checkpoints of the full state of a softbody.
+//
+//The file is little-endian and laid out so it can be memory mapped and used in place: a fixed size
+//header followed by one array per attribute, each starting on a cache line, exactly as the particle
+//store and spring table keep them in memory. Loading maps the file copy-on-write and points the
+//softbody's arrays straight into the mapping, so a checkpoint of any size is restored without reading
+//or copying it up front; pages are faulted in as the solver first touches them.
+//
+//Version 1 layout:
+//	SoftBodySnapshotHeader			128 bytes
+//	x, y, vx, vy, invMass			numParticles floats each
+//	a, b							numSprings uint32s each
+//	restLength, stiffness			numSprings floats each
+//with every array padded to a multiple of 64 bytes. The net forces are not stored; they are zero
+//between steps.
+
+#define SOFTBODY_SNAPSHOT_MAGIC "MSPRSNAP"
+#define SOFTBODY_SNAPSHOT_VERSION 1
+
+//The arrays of a snapshot, in file order
+enum SoftBodySnapshotArray
+{
+	SNAPSHOT_X,
+	SNAPSHOT_Y,
+	SNAPSHOT_VX,
+	SNAPSHOT_VY,
+	SNAPSHOT_INV_MASS,
+	SNAPSHOT_SPRING_A,
+	SNAPSHOT_SPRING_B,
+	SNAPSHOT_REST_LENGTH,
+	SNAPSHOT_STIFFNESS,
+	SNAPSHOT_NUM_ARRAYS
+};
+
+//The start of a snapshot file. Every field is little-endian.
+struct SoftBodySnapshotHeader
+{
+	char magic[8];					//SOFTBODY_SNAPSHOT_MAGIC, not null terminated
+	uint32_t version;				//SOFTBODY_SNAPSHOT_VERSION of the writer
+	uint32_t headerSize;			//sizeof(SoftBodySnapshotHeader)
+
+	int32_t subdivisionsX;
+	int32_t subdivisionsY;
+	float restWidth;
+	float restHeight;
+	float coefficient;
+	float dampening;
+
+	uint32_t numParticles;
+	uint32_t numSprings;
+	uint64_t offsets[SNAPSHOT_NUM_ARRAYS];	//Byte offset of each array from the start of the file
+	uint64_t fileSize;						//The size of the whole file
+};
+
+///
+//Writes the full state of a softbody to a snapshot file
+//
+//Parameters:
+//	body: The softbody to save
+//	path: The file to write, replaced once the new snapshot is complete
+//
+//Returns:
+//	False if the file could not be written
+bool SaveSoftBody(const SoftBody &body, const char* path);
+
+///
+//Restores a softbody from a snapshot file, replacing its particles and springs.
+//On little-endian machines the arrays are mapped from the file rather than copied; the body keeps
+//the mapping open until it is destroyed or loaded again. The header, the array bounds and every
+//spring are checked; the particle arrays are trusted.
+//
+//Parameters:
+//	body: The softbody to restore into
+//	path: The snapshot file to read
+//
+//Returns:
+//	False if the file could not be read or is not a snapshot this version understands,
+//	in which case the body is left untouched
+bool LoadSoftBody(SoftBody &body, const char* path);
+
+#endif //_SOFTBODY_SNAPSHOT_H
@@ -0,0 +1,257 @@
+/*
+Softbody solver
+
+Each step runs three passes over the lattice, split into one band of rows per thread:
+	1. Evaluate the springs starting in each band and scatter them to the endpoints inside it
+	2. Scatter the springs crossing into the next band to their second endpoint
+	3. Apply external forces and integrate
+Returning from ThreadPool::Run is the barrier between passes.
+
+Each spring's force is evaluated once into the spring table, and a particle's net force is the sum of
+those forces in spring order, split only where a band ends. The sums therefore depend on the number of
+bands and on nothing else. Deterministic mode keeps the number of bands the same on any machine, and
+the pool runs the extra bands on the threads it has.
+*/
+
+#include "SoftBodySolver.h"
+#include "Profiler.h"
+
+#include <cmath>
+
+void IntegrateLinear(float dt, ParticleStore &particles, unsigned int begin, unsigned int end)
+{
+	float halfDt2 = 0.5f * dt * dt;
+
+	float* x = particles.x;
+	float* y = particles.y;
+	float* vx = particles.vx;
+	float* vy = particles.vy;
+	float* fx = particles.fx;
+	float* fy = particles.fy;
+	const float* invMass = particles.invMass;
+
+	for (unsigned int i = begin; i < end; ++i)
+	{
+		//Calculate the current acceleration
+		float ax = invMass[i] * fx[i];
+		float ay = invMass[i] * fy[i];
+
+		//Calculate new position with
+		//	X = X0 + V0*dt + (1/2) * A * dt^2
+		x[i] += dt * vx[i] + halfDt2 * ax;
+		y[i] += dt * vy[i] + halfDt2 * ay;
+
+		//determine the new velocity
+		vx[i] += dt * ax;
+		vy[i] += dt * ay;
+
+		//Zero the net force!
+		fx[i] = fy[i] = 0.0f;
+	}
+}
+
+void ApplySpringForces(SoftBody &body, SpringForceKernel kernel, int firstRow, int endRow)
+{
+	ParticleStore &p = body.particles;
+	SpringTable &springs = body.springs;
+	float damp = body.dampening;
+
+	unsigned int endParticle = endRow * body.subdivisionsX;
+	unsigned int begin = springs.LowerBound(firstRow * body.subdivisionsX);
+	unsigned int end = springs.LowerBound(endParticle);
+
+	//Evaluate Hooke's law for every spring
+	kernel(p.x, p.y, springs, begin, end);
+
+	//Scatter the spring forces to their endpoints
+	for (unsigned int s = begin; s < end; ++s)
+	{
+		unsigned int a = springs.a[s];
+		unsigned int b = springs.b[s];
+		float sx = springs.forceX[s];
+		float sy = springs.forceY[s];
+
+		//Newton's third law: a is pulled towards b and b towards a.
+		//And from that we must add the dampening force of each end:
+		//Fdamp = -V * C 
+		//Where C is the dampening constant
+		p.fx[a] += sx - p.vx[a] * damp;
+		p.fy[a] += sy - p.vy[a] * damp;
+
+		if (b < endParticle)
+		{
+			p.fx[b] += -sx - p.vx[b] * damp;
+			p.fy[b] += -sy - p.vy[b] * damp;
+		}
+	}
+}
+
+void ApplyBoundarySpringForces(SoftBody &body, int endRow)
+{
+	ParticleStore &p = body.particles;
+	SpringTable &springs = body.springs;
+	float damp = body.dampening;
+
+	unsigned int endParticle = endRow * body.subdivisionsX;
+	unsigned int begin = springs.LowerBound((endRow - 1) * body.subdivisionsX);
+	unsigned int end = springs.LowerBound(endParticle);
+
+	for (unsigned int s = begin; s < end; ++s)
+	{
+		unsigned int b = springs.b[s];
+		if (b >= endParticle)
+		{
+			p.fx[b] += -springs.forceX[s] - p.vx[b] * damp;
+			p.fy[b] += -springs.forceY[s] - p.vy[b] * damp;
+		}
+	}
+}
+
+SoftBodySolver::SoftBodySolver(int threads, SpringKernelISA maxISA)
+{
+	Init(new ThreadPool(threads), true, maxISA);
+}
+
+SoftBodySolver::SoftBodySolver(ThreadPool* sharedPool, SpringKernelISA maxISA)
+{
+	Init(sharedPool, false, maxISA);
+}
+
+void SoftBodySolver::Init(ThreadPool* threads, bool owned, SpringKernelISA maxISA)
+{
+	isa = DetectSpringKernelISA();
+	if (isa > maxISA) isa = maxISA;
+	kernel = GetSpringForceKernel(isa);
+
+	pool = threads;
+	ownsPool = owned;
+
+	integrator = INTEGRATOR_EXPLICIT_EULER;
+	deterministic = false;
+	cgMaxIterations = 50;
+	cgTolerance = 1e-4f;
+	cgIterations = 0;
+	xpbdIterations = 10;
+	collisionRadius = 0.0f;
+	sleepThreshold = 0.0f;
+	sleepSteps = 30;
+}
+
+SoftBodySolver::~SoftBodySolver()
+{
+	if (ownsPool) delete pool;
+}
+
+void WriteVertexPositions(const ParticleStore &particles, unsigned int begin, unsigned int end, float* dest, unsigned int stride)
+{
+	const float* x = particles.x;
+	const float* y = particles.y;
+
+	float* vertex = dest + (size_t)begin * stride;
+	for (unsigned int i = begin; i < end; ++i)
+	{
+		vertex[0] = x[i];
+		vertex[1] = y[i];
+		vertex += stride;
+	}
+}
+
+void SoftBodySolver::Step(SoftBody &body, float dt, float externalX, float externalY)
+{
+	PROFILE_ZONE("Step");
+
+	switch (integrator)
+	{
+	case INTEGRATOR_IMPLICIT_EULER:
+	{
+		PROFILE_ZONE("Implicit Euler");
+		cgIterations = StepImplicitEuler(body, implicit, *pool, NumBands(body), kernel, dt, externalX, externalY, cgMaxIterations, cgTolerance);
+		break;
+	}
+	case INTEGRATOR_XPBD:
+	{
+		PROFILE_ZONE("XPBD");
+		if (StepXPBD(body, xpbd, *pool, NumBands(body), dt, externalX, externalY, xpbdIterations)) break;
+	}
+	//Springs too tangled to colour are stepped with explicit Euler instead
+	//Falls through
+	default:
+		if (sleepThreshold > 0.0f)
+		{
+			StepSleepingExplicitEuler(body, sleep, *pool, NumBands(body), kernel, dt, externalX, externalY, sleepThreshold, sleepSteps);
+			break;
+		}
+		SolveSprings(body);
+		Integrate(body, dt, externalX, externalY);
+		break;
+	}
+
+	if (collisionRadius > 0.0f)
+	{
+		PROFILE_ZONE("Self-collision");
+		SolveSelfCollisions(body.particles, collision, *pool, pool->numThreads, collisionRadius);
+		if (sleepThreshold > 0.0f) WakeCollidedTiles(body, sleep, collision);
+	}
+}
+
+int SoftBodySolver::NumBands(const SoftBody &body) const
+{
+	//The lattice is split into one band of rows per thread.
+	//The result only depends on the number of bands, never on thread timing, so fixing the number
+	//of bands fixes the order every force and dot product is summed in.
+	int bands = deterministic ? DETERMINISTIC_BANDS : pool->numThreads;
+	return bands < body.subdivisionsY ? bands : body.subdivisionsY;
+}
+
+void SoftBodySolver::SolveSprings(SoftBody &body)
+{
+	PROFILE_ZONE("Spring forces");
+	int height = body.subdivisionsY;
+	int bands = NumBands(body);
+
+	//Apply the spring forces to each particle making up the softbody
+	pool->Run(bands, [&](int band)
+	{
+		PROFILE_ZONE("Spring forces band");
+		int firstRow, endRow;
+		ThreadPool::Partition(height, bands, band, firstRow, endRow);
+		ApplySpringForces(body, kernel, firstRow, endRow);
+	});
+
+	//Then the springs crossing from one band into the next
+	pool->Run(bands, [&](int band)
+	{
+		PROFILE_ZONE("Boundary spring forces band");
+		int firstRow, endRow;
+		ThreadPool::Partition(height, bands, band, firstRow, endRow);
+		ApplyBoundarySpringForces(body, endRow);
+	});
+}
+
+void SoftBodySolver::Integrate(SoftBody &body, float dt, float externalX, float externalY)
+{
+	PROFILE_ZONE("Integrate");
+	ParticleStore &p = body.particles;
+	int width = body.subdivisionsX;
+	int height = body.subdivisionsY;
+	int bands = NumBands(body);
+
+	//Apply the external force to the bottom row and integrate kinematics
+	pool->Run(bands, [&](int band)
+	{
+		PROFILE_ZONE("Integrate band");
+		int firstRow, endRow;
+		ThreadPool::Partition(height, bands, band, firstRow, endRow);
+
+		if (firstRow == 0)
+		{
+			for (int j = 0; j < width; ++j)
+			{
+				p.fx[j] += externalX;
+				p.fy[j] += externalY;
+			}
+		}
+
+		IntegrateLinear(dt, p, firstRow * width, endRow * width);
+	});
+}
@@ -0,0 +1,300 @@
+#ifndef _SOFTBODY_SOLVER_H
+#define _SOFTBODY_SOLVER_H
+
+#include "SoftBody_Struct.h"
+#include "SpringKernels.h"
+#include "ThreadPool_Struct.h"
+#include "ImplicitSystem_Struct.h"
+#include "XPBDSystem_Struct.h"
+#include "CollisionSystem_Struct.h"
+#include "SleepSystem_Struct.h"
+
+//The solver has no dependency on GLFW, GLEW or an OpenGL context, so it can be built
+//into the headless tools as well as the viewer.
+
+///
+//Performs second order euler integration for linear motion
+//
+//Parameters:
+//	dt: The timestep
+//	particles: The point masses being integrated
+//	begin: Index of the first particle to integrate
+//	end: One past the index of the last particle to integrate
+void IntegrateLinear(float dt, ParticleStore &particles, unsigned int begin, unsigned int end);
+
+///
+//Evaluates the springs starting in a band of rows and accumulates the result into the net forces
+//of their particles. A spring whose second particle lies past the band (a vertical spring out of
+//its last row) only has its first particle updated here, see ApplyBoundarySpringForces.
+//Because no band writes outside its own rows, bands can be solved concurrently.
+//
+//Parameters:
+//	body: The softbody whose springs are being solved
+//	kernel: The spring force kernel to evaluate Hooke's law with
+//	firstRow: The first row of the band
+//	endRow: One past the last row of the band
+void ApplySpringForces(SoftBody &body, SpringForceKernel kernel, int firstRow, int endRow);
+
+///
+//Applies the second half of the springs ApplySpringForces skipped: those leaving the last row
+//of a band. They only write to the first row of the next band, so this can run concurrently
+//for every band once all ApplySpringForces calls have finished.
+//
+//Parameters:
+//	body: The softbody whose springs are being solved
+//	endRow: One past the last row of the band
+void ApplyBoundarySpringForces(SoftBody &body, int endRow);
+
+///
+//Writes particle positions into a vertex position array, such as the one a Mesh uploads
+//
+//Parameters:
+//	particles: The particles to read positions from
+//	begin: Index of the first particle to write
+//	end: One past the index of the last particle to write
+//	dest: Address of the x component of the first vertex; y is expected to follow x
+//	stride: The distance between consecutive vertices, in floats
+void WriteVertexPositions(const ParticleStore &particles, unsigned int begin, unsigned int end, float* dest, unsigned int stride);
+
+///
+//Advances a softbody one step with backward Euler, solving for the change in velocity with
+//matrix-free preconditioned conjugate gradients. Stable for any timestep.
+//
+//Parameters:
+//	body: The softbody to step
+//	system: Working storage for the solve
+//	pool: The threads to run on
+//	bands: The number of bands of rows to split the work into
+//	kernel: The spring force kernel to evaluate Hooke's law with
+//	dt: The timestep
+//	externalX: X component of the external force applied to the bottom row
+//	externalY: Y component of the external force applied to the bottom row
+//	maxIterations: The most conjugate gradient iterations to run
+//	tolerance: Stop once the residual is this fraction of the right hand side
+//
+//Returns:
+//	The number of conjugate gradient iterations run
+int StepImplicitEuler(SoftBody &body, ImplicitSystem &system, ThreadPool &pool, int bands, SpringForceKernel kernel,
+	float dt, float externalX, float externalY, int maxIterations, float tolerance);
+
+///
+//Advances a softbody one step with XPBD, projecting every spring as a distance constraint whose
+//compliance is the inverse of its coefficient. Stable for any timestep.
+//
+//Parameters:
+//	body: The softbody to step
+//	system: Working storage for the projection
+//	pool: The threads to run on
+//	bands: The number of bands of rows to split the per-particle work into
+//	dt: The timestep
+//	externalX: X component of the external force applied to the bottom row
+//	externalY: Y component of the external force applied to the bottom row
+//	iterations: The number of times every constraint is projected
+//
+//Returns:
+//	False if the springs could not be coloured, in which case the body was not stepped; SoftBodySolver
+//	and World then step it with explicit Euler
+bool StepXPBD(SoftBody &body, XPBDSystem &system, ThreadPool &pool, int bands, float dt, float externalX, float externalY, int iterations);
+
+///
+//Separates particles closer than twice the given radius, moving them apart along the line between
+//them and removing the velocity they approach each other with. Neighbours are found through a
+//spatial hash rebuilt with a counting sort on every call.
+//
+//Parameters:
+//	particles: The particles to collide with each other
+//	system: Working storage for the spatial hash
+//	pool: The threads to run on
+//	tasks: The number of ranges of particles to split the work into
+//	radius: The radius of each particle
+//
+//Returns:
+//	The number of colliding pairs found
+unsigned int SolveSelfCollisions(ParticleStore &particles, CollisionSystem &system, ThreadPool &pool, int tasks, float radius);
+
+///
+//Wakes the sleeping tiles of a softbody that were disturbed since the last step, then marks the tiles
+//whose springs the step must solve. Starts with every tile awake if the system was built for another body.
+//
+//Parameters:
+//	body: The softbody being stepped
+//	system: The softbody's sleep state
+//	externalX: X component of the external force applied to the bottom row this step
+//	externalY: Y component of the external force applied to the bottom row this step
+//	threshold: The mean kinetic energy per unit mass below which a tile counts as still
+//
+//Returns:
+//	The number of tiles awake for the step
+unsigned int PrepareSleep(SoftBody &body, SleepSystem &system, float externalX, float externalY, float threshold);
+
+///
+//ApplySpringForces for a band of tile rows, skipping the springs of tiles that are neither awake nor
+//next to an awake tile. Call PrepareSleep first.
+//
+//Parameters:
+//	body: The softbody whose springs are being solved
+//	system: The softbody's sleep state
+//	kernel: The spring force kernel to evaluate Hooke's law with
+//	firstTileRow: The first row of tiles of the band
+//	endTileRow: One past the last row of tiles of the band
+void ApplyActiveSpringForces(SoftBody &body, const SleepSystem &system, SpringForceKernel kernel, int firstTileRow, int endTileRow);
+
+///
+//ApplyBoundarySpringForces for a band of tile rows, for the springs ApplyActiveSpringForces solved
+//
+//Parameters:
+//	body: The softbody whose springs are being solved
+//	system: The softbody's sleep state
+//	firstTileRow: The first row of tiles of the band
+//	endTileRow: One past the last row of tiles of the band
+void ApplyActiveBoundarySpringForces(SoftBody &body, const SleepSystem &system, int firstTileRow, int endTileRow);
+
+///
+//Integrates the awake tiles of a band of tile rows and discards the forces on the sleeping ones,
+//then puts the tiles that have been still for long enough to sleep
+//
+//Parameters:
+//	dt: The timestep
+//	body: The softbody to integrate
+//	system: The softbody's sleep state
+//	firstTileRow: The first row of tiles of the band
+//	endTileRow: One past the last row of tiles of the band
+//	threshold: The mean kinetic energy per unit mass below which a tile counts as still
+//	sleepSteps: The number of steps in a row a tile must be still before it sleeps
+void IntegrateAwake(float dt, SoftBody &body, SleepSystem &system, int firstTileRow, int endTileRow, float threshold, int sleepSteps);
+
+///
+//Advances a softbody one explicit Euler step, skipping the tiles that have settled
+//
+//Parameters:
+//	body: The softbody to step
+//	system: The softbody's sleep state, kept from one step to the next
+//	pool: The threads to run on
+//	bands: The most bands of tile rows to split the work into
+//	kernel: The spring force kernel to evaluate Hooke's law with
+//	dt: The timestep
+//	externalX: X component of the external force applied to the bottom row
+//	externalY: Y component of the external force applied to the bottom row
+//	threshold: The mean kinetic energy per unit mass below which a tile counts as still
+//	sleepSteps: The number of steps in a row a tile must be still before it sleeps
+//
+//Returns:
+//	The number of tiles that were awake for the step
+unsigned int StepSleepingExplicitEuler(SoftBody &body, SleepSystem &system, ThreadPool &pool, int bands, SpringForceKernel kernel,
+	float dt, float externalX, float externalY, float threshold, int sleepSteps);
+
+///
+//Wakes the tiles of every particle the last SolveSelfCollisions moved or slowed, so a sleeping tile
+//something landed on is integrated again from the next step. Does nothing if the sleep state was
+//built for another body, as PrepareSleep then wakes every tile anyway.
+//
+//Parameters:
+//	body: The softbody that was collided
+//	system: The softbody's sleep state
+//	collision: The softbody's collision state, holding the corrections of the last call
+void WakeCollidedTiles(const SoftBody &body, SleepSystem &system, const CollisionSystem &collision);
+
+//The time integration schemes the solver can step with
+enum IntegratorType
+{
+	INTEGRATOR_EXPLICIT_EULER,		//Second order explicit Euler, cheap but needs small steps for stiff springs
+	INTEGRATOR_IMPLICIT_EULER,		//Backward Euler with a conjugate gradient solve, stable at large steps
+	INTEGRATOR_XPBD					//Position based distance constraints, stable at large steps
+};
+
+//The number of bands a lattice is split into in deterministic mode, whatever the number of threads
+#define DETERMINISTIC_BANDS 64
+
+//Steps softbodies forward in time.
+//Owns the worker threads and the spring force kernel picked for this CPU.
+struct SoftBodySolver
+{
+	SpringKernelISA isa;		//The instruction set of the kernel in use
+	SpringForceKernel kernel;	//The spring force kernel in use
+	struct ThreadPool* pool;	//The threads the solver passes are split across
+	bool ownsPool;				//Whether the pool was started by this solver and is stopped with it
+
+	IntegratorType integrator;	//The integration scheme Step uses
+	bool deterministic;			//Whether to split every lattice into DETERMINISTIC_BANDS bands rather than one per thread,
+								//so the results are the same bits on any number of threads
+	int cgMaxIterations;		//Implicit Euler: the most conjugate gradient iterations per step
+	float cgTolerance;			//Implicit Euler: the relative residual at which the solve stops
+	int cgIterations;			//Implicit Euler: the iterations the last step took
+	struct ImplicitSystem implicit;	//Implicit Euler: working storage
+	int xpbdIterations;			//XPBD: the number of times every constraint is projected per step
+	struct XPBDSystem xpbd;		//XPBD: working storage
+	float collisionRadius;		//The radius of each particle for self-collision, 0 to disable it
+	struct CollisionSystem collision;	//Self-collision: working storage
+	float sleepThreshold;		//Explicit Euler: the mean kinetic energy per unit mass below which a tile may sleep, 0 to never sleep
+	int sleepSteps;				//Explicit Euler: the number of steps in a row a tile must be still before it sleeps
+	struct SleepSystem sleep;	//Explicit Euler: which tiles of the last body stepped are asleep
+
+	///
+	//Parameterized constructor, starts the worker threads and picks a kernel
+	//
+	//Parameters:
+	//	threads: The number of threads to solve with (0 for one per hardware thread)
+	//	maxISA: The widest instruction set to use, even if the CPU supports a wider one
+	SoftBodySolver(int threads, SpringKernelISA maxISA = SPRING_KERNEL_AVX2);
+
+	///
+	//Parameterized constructor, runs on threads shared with other solvers and picks a kernel.
+	//Each solver keeps its own working storage, so one solver per softbody avoids rebuilding it
+	//every time a different body is stepped.
+	//
+	//Parameters:
+	//	sharedPool: The threads to solve with, which must outlive the solver
+	//	maxISA: The widest instruction set to use, even if the CPU supports a wider one
+	SoftBodySolver(ThreadPool* sharedPool, SpringKernelISA maxISA = SPRING_KERNEL_AVX2);
+	~SoftBodySolver();
+
+	///
+	//Shared by the constructors: picks a kernel and sets the default settings
+	//
+	//Parameters:
+	//	threads: The threads to solve with
+	//	owned: Whether to stop the threads with the solver
+	//	maxISA: The widest instruction set to use
+	void Init(ThreadPool* threads, bool owned, SpringKernelISA maxISA);
+
+	///
+	//Advances a softbody by one timestep with the selected integrator, then resolves self-collisions
+	//if they are enabled. With explicit Euler and a sleep threshold, settled tiles are skipped; the
+	//solver keeps one body's sleep state, so a solver stepping several bodies should not sleep them.
+	//
+	//Parameters:
+	//	body: The softbody to step
+	//	dt: The timestep
+	//	externalX: X component of the external force applied to the bottom row
+	//	externalY: Y component of the external force applied to the bottom row
+	void Step(SoftBody &body, float dt, float externalX, float externalY);
+
+	///
+	//Evaluates every spring of a softbody and accumulates the result into its particles' net forces.
+	//This is the first half of an explicit Euler step.
+	//
+	//Parameters:
+	//	body: The softbody whose springs are being solved
+	void SolveSprings(SoftBody &body);
+
+	///
+	//Applies the external force to the bottom row and integrates every particle of a softbody.
+	//This is the second half of an explicit Euler step.
+	//
+	//Parameters:
+	//	body: The softbody to integrate
+	//	dt: The timestep
+	//	externalX: X component of the external force applied to the bottom row
+	//	externalY: Y component of the external force applied to the bottom row
+	void Integrate(SoftBody &body, float dt, float externalX, float externalY);
+
+	///
+	//Returns the number of bands of rows the given softbody is split into: one per thread, or
+	//DETERMINISTIC_BANDS in deterministic mode, but never more than it has rows
+	//
+	//Parameters:
+	//	body: The softbody being solved
+	int NumBands(const SoftBody &body) const;
+};
+
+#endif //_SOFTBODY_SOLVER_H
@@ -2,7 +2,9 @@
 #define _SOFTBODY_STRUCT_H
 
 
-#include "GLIncludes.h"
+#include "ParticleStore_Struct.h"
+#include "SpringTable_Struct.h"
+#include "MappedFile_Struct.h"
 
 
 //A struct for 1D Mass-Spring softbody physics
@@ -14,17 +16,26 @@ struct SoftBody
 	float restHeight;
 	float restWidth;
 
-	//The rigidbodies of the point masses which make up the softbody mass-spring system
-	unsigned int numRigidBodies;
-	struct RigidBody** bodies;
+	//The point masses which make up the softbody mass-spring system.
+	//Particle (i, j) is stored at index i * subdivisionsX + j.
+	unsigned int numParticles;
+	struct ParticleStore particles;
+
+	//The springs connecting each particle to its right and upper neighbours.
+	//Built once on construction, in row-major order of their first particle.
+	struct SpringTable springs;
 
 	float coefficient;	//The spring coefficients between the point masses in the system
 						//float restLength;	//The resting length of the springs
 	float dampening;	//The dampening coefficient of the springs
 
-	SoftBody::SoftBody()
+	//The snapshot the particle and spring arrays were restored from, if any, see LoadSoftBody.
+	//Released after the arrays which point into it.
+	struct MappedFile mapping;
+
+	SoftBody()
 	{
-		numRigidBodies = 0;
+		numParticles = 0;
 		coefficient = 0.0f;
 		//restLength = 0.0f;
 		dampening = 0.0f;
@@ -33,7 +44,7 @@ struct SoftBody
 		restHeight = restWidth = 0;
 	}
 
-	SoftBody::SoftBody(
+	SoftBody(
 		float width, float height,
 		int subX, int subY,
 		float coeff, float damp
@@ -42,7 +53,7 @@ struct SoftBody
 		subdivisionsX = subX;
 		subdivisionsY = subY;
 
-		numRigidBodies = subX * subY;
+		numParticles = subX * subY;
 		coefficient = coeff;
 		//restLength = rest;
 		dampening = damp;
@@ -57,26 +68,39 @@ struct SoftBody
 
 		restHeight = heightStep;
 
-		bodies = new struct RigidBody*[subY];
+		particles.Allocate(numParticles);
+		for (int i = 0; i < subdivisionsY; ++i)
+		{
+			for (int j = 0; j < subdivisionsX; ++j)
+			{
+				int index = i * subdivisionsX + j;
+				particles.x[index] = startWidth + widthStep * j;
+				particles.y[index] = startHeight + heightStep * i;
+				particles.invMass[index] = 1.0f;
+			}
+		}
+
+		//Horizontal springs: (subX - 1) per row, vertical springs: subX per row but the last
+		springs.Allocate((subX - 1) * subY + subX * (subY - 1));
 		for (int i = 0; i < subdivisionsY; ++i)
 		{
-			bodies[i] = new struct RigidBody[subX];
 			for (int j = 0; j < subdivisionsX; ++j)
 			{
-				bodies[i][j] = struct RigidBody(glm::vec3(startWidth + widthStep * j, startHeight + heightStep * i, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f);
+				unsigned int index = i * subdivisionsX + j;
+				if (j < subdivisionsX - 1)
+					springs.Add(index, index + 1, restWidth, coefficient);
+				if (i < subdivisionsY - 1)
+					springs.Add(index, index + subdivisionsX, restHeight, coefficient);
 			}
 		}
 
 
 	}
 
-	SoftBody::~SoftBody()
+	~SoftBody()
 	{
-		for (int i = 0; i < subdivisionsY; ++i)
-		{
-			delete[] bodies[i];
-		}
-		delete[] bodies;
+		particles.Release();
+		springs.Release();
 	}
 };
-#endif _SOFTBODY_STRUCT_H
\ No newline at end of file
+#endif //_SOFTBODY_STRUCT_H
\ No newline at end of file
@@ -0,0 +1,222 @@
+/*
+Spring force kernels
+
+The scalar kernel is the reference implementation: it computes the spring length with a
+square root and divides by it to get the direction. The SIMD kernels instead use the
+approximate reciprocal square root followed by one Newton-Raphson refinement, which gives
+close to full float precision without a sqrt or a divide:
+
+	r = rsqrt(L^2)
+	r = r * (1.5 - 0.5 * L^2 * r * r)
+
+Since the direction is dX * r and the length is L^2 * r, the Hooke's law force becomes
+
+	F = k * (L - rest) * dX / L = k * (1 - rest * r) * dX
+
+The kernel to use is selected once at startup from CPUID, so a single binary runs on
+every machine and still uses the widest vectors available.
+*/
+
+#include "SpringKernels.h"
+
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SPRING_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+//MSVC allows any intrinsic in any function, GCC and Clang need to be told per function.
+#if defined(SPRING_KERNELS_X86) && !defined(_MSC_VER)
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define KERNEL_TARGET(isa)
+#endif
+
+///
+//Reference kernel, one spring at a time
+static void SpringForcesScalar(const float* x, const float* y, SpringTable &springs, unsigned int begin, unsigned int end)
+{
+	for (unsigned int s = begin; s < end; ++s)
+	{
+		unsigned int a = springs.a[s];
+		unsigned int b = springs.b[s];
+
+		//Get displacement from particle a to particle b
+		float dx = x[b] - x[a];
+		float dy = y[b] - y[a];
+		//Extract the magnitude from this displacement
+		float mag = sqrtf(dx * dx + dy * dy);
+
+		//Fspring = -k(dX), the direction is dX / mag so fold the divide into the scale.
+		float scale = springs.stiffness[s] * (mag - springs.restLength[s]) / mag;
+		springs.forceX[s] = scale * dx;
+		springs.forceY[s] = scale * dy;
+	}
+}
+
+#ifdef SPRING_KERNELS_X86
+
+///
+//SSE kernel, four springs per iteration
+KERNEL_TARGET("sse4.2")
+static void SpringForcesSSE42(const float* x, const float* y, SpringTable &springs, unsigned int begin, unsigned int end)
+{
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 threeHalves = _mm_set1_ps(1.5f);
+
+	unsigned int s = begin;
+	for (; s + 4 <= end; s += 4)
+	{
+		const unsigned int* a = springs.a + s;
+		const unsigned int* b = springs.b + s;
+
+		//SSE has no gather, so assemble the endpoint positions lane by lane
+		__m128 dx = _mm_sub_ps(
+			_mm_set_ps(x[b[3]], x[b[2]], x[b[1]], x[b[0]]),
+			_mm_set_ps(x[a[3]], x[a[2]], x[a[1]], x[a[0]]));
+		__m128 dy = _mm_sub_ps(
+			_mm_set_ps(y[b[3]], y[b[2]], y[b[1]], y[b[0]]),
+			_mm_set_ps(y[a[3]], y[a[2]], y[a[1]], y[a[0]]));
+
+		__m128 len2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+		//Reciprocal length with one Newton-Raphson step
+		__m128 r = _mm_rsqrt_ps(len2);
+		r = _mm_mul_ps(r, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, len2), _mm_mul_ps(r, r))));
+
+		//k * (1 - rest / L)
+		__m128 k = _mm_loadu_ps(springs.stiffness + s);
+		__m128 rest = _mm_loadu_ps(springs.restLength + s);
+		__m128 scale = _mm_sub_ps(k, _mm_mul_ps(_mm_mul_ps(k, rest), r));
+
+		_mm_storeu_ps(springs.forceX + s, _mm_mul_ps(scale, dx));
+		_mm_storeu_ps(springs.forceY + s, _mm_mul_ps(scale, dy));
+	}
+
+	//Remainder
+	SpringForcesScalar(x, y, springs, s, end);
+}
+
+///
+//AVX2 kernel, eight springs per iteration using hardware gathers
+KERNEL_TARGET("avx2")
+static void SpringForcesAVX2(const float* x, const float* y, SpringTable &springs, unsigned int begin, unsigned int end)
+{
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 threeHalves = _mm256_set1_ps(1.5f);
+
+	unsigned int s = begin;
+	for (; s + 8 <= end; s += 8)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)(springs.a + s));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(springs.b + s));
+
+		__m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(x, b, 4), _mm256_i32gather_ps(x, a, 4));
+		__m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(y, b, 4), _mm256_i32gather_ps(y, a, 4));
+
+		__m256 len2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+		//Reciprocal length with one Newton-Raphson step
+		__m256 r = _mm256_rsqrt_ps(len2);
+		r = _mm256_mul_ps(r, _mm256_sub_ps(threeHalves, _mm256_mul_ps(_mm256_mul_ps(half, len2), _mm256_mul_ps(r, r))));
+
+		//k * (1 - rest / L)
+		__m256 k = _mm256_loadu_ps(springs.stiffness + s);
+		__m256 rest = _mm256_loadu_ps(springs.restLength + s);
+		__m256 scale = _mm256_sub_ps(k, _mm256_mul_ps(_mm256_mul_ps(k, rest), r));
+
+		_mm256_storeu_ps(springs.forceX + s, _mm256_mul_ps(scale, dx));
+		_mm256_storeu_ps(springs.forceY + s, _mm256_mul_ps(scale, dy));
+	}
+
+	//Remainder
+	SpringForcesScalar(x, y, springs, s, end);
+}
+
+///
+//Executes CPUID for the given leaf and subleaf
+static void CpuId(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+///
+//Reads the extended control register which says which register files the OS saves
+static unsigned long long ReadXCR0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int lo, hi;
+	__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+#endif //SPRING_KERNELS_X86
+
+SpringKernelISA DetectSpringKernelISA()
+{
+#ifdef SPRING_KERNELS_X86
+	unsigned int regs[4];
+	CpuId(0, 0, regs);
+	unsigned int maxLeaf = regs[0];
+
+	CpuId(1, 0, regs);
+	bool sse42 = (regs[2] & (1u << 20)) != 0;
+	bool osxsave = (regs[2] & (1u << 27)) != 0;
+	bool avx = (regs[2] & (1u << 28)) != 0;
+
+	//AVX registers are only usable if the OS saves the upper halves on a context switch
+	bool avxState = osxsave && avx && (ReadXCR0() & 0x6) == 0x6;
+
+	bool avx2 = false;
+	if (maxLeaf >= 7)
+	{
+		CpuId(7, 0, regs);
+		avx2 = avxState && (regs[1] & (1u << 5)) != 0;
+	}
+
+	if (avx2) return SPRING_KERNEL_AVX2;
+	if (sse42) return SPRING_KERNEL_SSE42;
+#endif
+	return SPRING_KERNEL_SCALAR;
+}
+
+SpringForceKernel GetSpringForceKernel(SpringKernelISA isa)
+{
+	switch (isa)
+	{
+#ifdef SPRING_KERNELS_X86
+	case SPRING_KERNEL_AVX2:
+		return SpringForcesAVX2;
+	case SPRING_KERNEL_SSE42:
+		return SpringForcesSSE42;
+#endif
+	default:
+		return SpringForcesScalar;
+	}
+}
+
+const char* GetSpringKernelName(SpringKernelISA isa)
+{
+	switch (isa)
+	{
+	case SPRING_KERNEL_AVX2:
+		return "AVX2";
+	case SPRING_KERNEL_SSE42:
+		return "SSE4.2";
+	default:
+		return "scalar";
+	}
+}
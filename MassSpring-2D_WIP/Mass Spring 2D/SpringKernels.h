@@ -0,0 +1,39 @@
+#ifndef _SPRING_KERNELS_H
+#define _SPRING_KERNELS_H
+
+#include "SpringTable_Struct.h"
+
+//The instruction sets a spring force kernel can be built for
+enum SpringKernelISA
+{
+	SPRING_KERNEL_SCALAR,
+	SPRING_KERNEL_SSE42,
+	SPRING_KERNEL_AVX2
+};
+
+///
+//A spring force kernel evaluates Hooke's law for the springs [begin, end) of a table.
+//The force each spring exerts on its first particle is written to springs.forceX/forceY;
+//the second particle receives the negation. Dampening is not included.
+//
+//Parameters:
+//	x: Particle x positions
+//	y: Particle y positions
+//	springs: The spring table being evaluated
+//	begin: Index of the first spring to evaluate
+//	end: One past the index of the last spring to evaluate
+typedef void (*SpringForceKernel)(const float* x, const float* y, SpringTable &springs, unsigned int begin, unsigned int end);
+
+///
+//Queries the CPU (and OS) for the widest instruction set a kernel is available for
+SpringKernelISA DetectSpringKernelISA();
+
+///
+//Returns the kernel built for the given instruction set
+SpringForceKernel GetSpringForceKernel(SpringKernelISA isa);
+
+///
+//Returns a printable name for the given instruction set
+const char* GetSpringKernelName(SpringKernelISA isa);
+
+#endif //_SPRING_KERNELS_H
@@ -0,0 +1,192 @@
+#ifndef _SPRINGTABLE_STRUCT_H
+#define _SPRINGTABLE_STRUCT_H
+
+#include "Arena_Struct.h"
+
+//Explicit list of the springs in a mass-spring system.
+//Every spring is stored exactly once, so the force pass can evaluate it a single time
+//and apply equal and opposite forces to both of its endpoints.
+//Like the particles, the springs are kept as structure-of-arrays.
+struct SpringTable
+{
+	unsigned int count;		//The number of springs in the table
+	unsigned int capacity;	//The number of springs the arrays have room for
+
+	unsigned int* a;		//Index of the first particle of each spring
+	unsigned int* b;		//Index of the second particle of each spring
+	float* restLength;		//The resting length of each spring
+	float* stiffness;		//The spring coefficient of each spring
+
+	float* forceX;			//Scratch space: the Hooke's law force each spring exerts on its first particle
+	float* forceY;
+
+	bool borrowed;			//Whether the topology, rest length and stiffness arrays belong to someone else,
+							//such as a memory mapped snapshot or an arena, and must not be freed
+	bool forcesBorrowed;	//Whether the scratch force arrays belong to someone else too
+
+	///
+	//Default constructor, creates an empty table
+	SpringTable()
+	{
+		count = capacity = 0;
+		a = b = nullptr;
+		restLength = stiffness = nullptr;
+		forceX = forceY = nullptr;
+		borrowed = forcesBorrowed = false;
+	}
+
+	///
+	//Allocates room for the given number of springs, releasing any previous ones
+	//
+	//Parameters:
+	//	n: The maximum number of springs the table will hold
+	void Allocate(unsigned int n)
+	{
+		Release();
+		capacity = n;
+
+		a = (unsigned int*)AlignedAlloc(sizeof(unsigned int) * n);
+		b = (unsigned int*)AlignedAlloc(sizeof(unsigned int) * n);
+		restLength = (float*)AlignedAlloc(sizeof(float) * n);
+		stiffness = (float*)AlignedAlloc(sizeof(float) * n);
+		forceX = (float*)AlignedAlloc(sizeof(float) * n);
+		forceY = (float*)AlignedAlloc(sizeof(float) * n);
+	}
+
+	///
+	//Takes room for the given number of springs from an arena, releasing any previous ones.
+	//The arena owns the arrays, so the table never frees them.
+	//
+	//Parameters:
+	//	n: The maximum number of springs the table will hold
+	//	arena: The arena to take the arrays from, with room for ArenaSize(n) more bytes
+	void Allocate(unsigned int n, Arena &arena)
+	{
+		Release();
+		capacity = n;
+		borrowed = forcesBorrowed = true;
+
+		a = (unsigned int*)arena.Take(sizeof(unsigned int) * n);
+		b = (unsigned int*)arena.Take(sizeof(unsigned int) * n);
+		restLength = (float*)arena.Take(sizeof(float) * n);
+		stiffness = (float*)arena.Take(sizeof(float) * n);
+		forceX = (float*)arena.Take(sizeof(float) * n);
+		forceY = (float*)arena.Take(sizeof(float) * n);
+	}
+
+	///
+	//Returns the bytes Allocate takes from an arena for the given number of springs
+	static size_t ArenaSize(unsigned int n)
+	{
+		return 2 * Arena::Footprint(sizeof(unsigned int) * n) + 4 * Arena::Footprint(sizeof(float) * n);
+	}
+
+	///
+	//Points the table at an existing, full set of springs without copying them, releasing any previous
+	//ones. The arrays must be cache line aligned, sorted by first particle and outlive the table.
+	//Scratch space for the forces is allocated as usual.
+	//
+	//Parameters:
+	//	n: The number of springs
+	//	pa, pb: The first and second particle of each spring
+	//	pRestLength: The resting length of each spring
+	//	pStiffness: The spring coefficient of each spring
+	void Borrow(unsigned int n, unsigned int* pa, unsigned int* pb, float* pRestLength, float* pStiffness)
+	{
+		Release();
+		count = capacity = n;
+		borrowed = true;
+
+		a = pa;
+		b = pb;
+		restLength = pRestLength;
+		stiffness = pStiffness;
+		forceX = (float*)AlignedAlloc(sizeof(float) * n);
+		forceY = (float*)AlignedAlloc(sizeof(float) * n);
+	}
+
+	///
+	//Points the table at a range of another table's springs, scratch space included, without copying
+	//them, releasing any previous ones. The particle indices are used as they are stored.
+	//
+	//Parameters:
+	//	source: The table to borrow from, which must outlive this one
+	//	first: The index in source of this table's first spring, a multiple of 16 to keep the arrays cache line aligned
+	//	n: The number of springs
+	void Borrow(const SpringTable &source, unsigned int first, unsigned int n)
+	{
+		Release();
+		count = capacity = n;
+		borrowed = forcesBorrowed = true;
+
+		a = source.a + first;
+		b = source.b + first;
+		restLength = source.restLength + first;
+		stiffness = source.stiffness + first;
+		forceX = source.forceX + first;
+		forceY = source.forceY + first;
+	}
+
+	///
+	//Appends a spring to the table
+	//
+	//Parameters:
+	//	first: Index of the first particle
+	//	second: Index of the second particle
+	//	rest: The resting length of the spring
+	//	k: The spring coefficient
+	void Add(unsigned int first, unsigned int second, float rest, float k)
+	{
+		a[count] = first;
+		b[count] = second;
+		restLength[count] = rest;
+		stiffness[count] = k;
+		++count;
+	}
+
+	///
+	//Finds the first spring whose first particle is at or after the given particle.
+	//Springs are added in order of their first particle, so the springs starting in a
+	//contiguous range of particles are themselves a contiguous range of the table.
+	//
+	//Parameters:
+	//	particle: The particle index to search for
+	unsigned int LowerBound(unsigned int particle) const
+	{
+		unsigned int first = 0;
+		unsigned int last = count;
+		while (first < last)
+		{
+			unsigned int mid = first + (last - first) / 2;
+			if (a[mid] < particle) first = mid + 1;
+			else last = mid;
+		}
+		return first;
+	}
+
+	///
+	//Frees all arrays the table owns
+	void Release()
+	{
+		if (!borrowed)
+		{
+			AlignedFree(a);
+			AlignedFree(b);
+			AlignedFree(restLength);
+			AlignedFree(stiffness);
+		}
+		if (!forcesBorrowed)
+		{
+			AlignedFree(forceX);
+			AlignedFree(forceY);
+		}
+
+		count = capacity = 0;
+		a = b = nullptr;
+		restLength = stiffness = nullptr;
+		forceX = forceY = nullptr;
+		borrowed = forcesBorrowed = false;
+	}
+};
+
+#endif //_SPRINGTABLE_STRUCT_H
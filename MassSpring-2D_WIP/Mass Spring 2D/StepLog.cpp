@@ -0,0 +1,132 @@
+/*
+Step log
+
+The floats are stored as their bit patterns, byte by byte in little-endian order, so a log replays to
+the same bits on any machine.
+*/
+
+#include "StepLog.h"
+
+#include <cstring>
+
+//The bytes of one step
+#define STEP_LOG_RECORD 12
+
+///
+//Stores a float little-endian
+static void PutF32(unsigned char* out, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	for (int i = 0; i < 4; ++i) out[i] = (unsigned char)(bits >> (8 * i));
+}
+
+///
+//Loads a little-endian float
+static float GetF32(const unsigned char* in)
+{
+	uint32_t bits = 0;
+	for (int i = 0; i < 4; ++i) bits |= (uint32_t)in[i] << (8 * i);
+	float value;
+	memcpy(&value, &bits, 4);
+	return value;
+}
+
+StepLogWriter::StepLogWriter()
+{
+	file = nullptr;
+	stepsWritten = 0;
+	failed = false;
+}
+
+StepLogWriter::~StepLogWriter()
+{
+	Close();
+}
+
+bool StepLogWriter::Open(const char* path)
+{
+	Close();
+
+	file = fopen(path, "wb");
+	if (file == nullptr) return false;
+
+	unsigned char header[12];
+	memcpy(header, STEP_LOG_MAGIC, 8);
+	for (int i = 0; i < 4; ++i) header[8 + i] = (unsigned char)((uint32_t)STEP_LOG_VERSION >> (8 * i));
+
+	stepsWritten = 0;
+	failed = fwrite(header, sizeof(header), 1, file) != 1;
+	return true;
+}
+
+void StepLogWriter::Append(float dt, float externalX, float externalY)
+{
+	if (file == nullptr) return;
+
+	unsigned char record[STEP_LOG_RECORD];
+	PutF32(record, dt);
+	PutF32(record + 4, externalX);
+	PutF32(record + 8, externalY);
+
+	if (fwrite(record, sizeof(record), 1, file) != 1) failed = true;
+	++stepsWritten;
+}
+
+bool StepLogWriter::Close()
+{
+	if (file == nullptr) return !failed;
+
+	if (fclose(file) != 0) failed = true;
+	file = nullptr;
+	return !failed;
+}
+
+StepLogReader::StepLogReader()
+{
+	file = nullptr;
+}
+
+StepLogReader::~StepLogReader()
+{
+	Close();
+}
+
+bool StepLogReader::Open(const char* path)
+{
+	Close();
+
+	file = fopen(path, "rb");
+	if (file == nullptr) return false;
+
+	unsigned char header[12];
+	uint32_t version = 0;
+	bool ok = fread(header, sizeof(header), 1, file) == 1 && memcmp(header, STEP_LOG_MAGIC, 8) == 0;
+	for (int i = 0; ok && i < 4; ++i) version |= (uint32_t)header[8 + i] << (8 * i);
+
+	if (!ok || version != STEP_LOG_VERSION)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool StepLogReader::Next(float &dt, float &externalX, float &externalY)
+{
+	if (file == nullptr) return false;
+
+	unsigned char record[STEP_LOG_RECORD];
+	if (fread(record, sizeof(record), 1, file) != 1) return false;
+
+	dt = GetF32(record);
+	externalX = GetF32(record + 4);
+	externalY = GetF32(record + 8);
+	return true;
+}
+
+void StepLogReader::Close()
+{
+	if (file != nullptr) fclose(file);
+	file = nullptr;
+}
@@ -0,0 +1,94 @@
+#ifndef _STEP_LOG_H
+#define _STEP_LOG_H
+
+#include <cstdint>
+#include <cstdio>
+
+//A log of the steps a run took: the length of each and the external force applied during it.
+//Stepping the same starting state through the logged steps reproduces the run exactly, whether its
+//steps were fixed, chosen by the adaptive controller or driven by live input.
+//
+//File layout, little-endian:
+//	char[8] STEP_LOG_MAGIC, uint32 STEP_LOG_VERSION
+//	per step: float32 dt, float32 external force x, float32 external force y
+
+#define STEP_LOG_MAGIC "MSPRSTEP"
+#define STEP_LOG_VERSION 1
+
+//Appends steps to a log file
+struct StepLogWriter
+{
+	FILE* file;
+	uint64_t stepsWritten;
+	bool failed;				//Whether a write failed
+
+	///
+	//Default constructor, writes nothing until Open is called
+	StepLogWriter();
+	~StepLogWriter();
+
+	///
+	//Creates a log file and writes its header
+	//
+	//Parameters:
+	//	path: The file to write, replaced if it exists
+	//
+	//Returns:
+	//	False if the file could not be created
+	bool Open(const char* path);
+
+	///
+	//Appends a step
+	//
+	//Parameters:
+	//	dt: The length of the step
+	//	externalX: X component of the external force applied during the step
+	//	externalY: Y component of the external force applied during the step
+	void Append(float dt, float externalX, float externalY);
+
+	///
+	//Closes the file
+	//
+	//Returns:
+	//	False if any write failed
+	bool Close();
+};
+
+//Reads the steps of a log file in order
+struct StepLogReader
+{
+	FILE* file;
+
+	///
+	//Default constructor, reads nothing until Open is called
+	StepLogReader();
+	~StepLogReader();
+
+	///
+	//Opens a log file and checks its header
+	//
+	//Parameters:
+	//	path: The file to read
+	//
+	//Returns:
+	//	False if the file could not be read or is not a log this version understands
+	bool Open(const char* path);
+
+	///
+	//Reads the next step
+	//
+	//Parameters:
+	//	dt: Set to the length of the step
+	//	externalX: Set to the X component of the external force applied during the step
+	//	externalY: Set to the Y component of the external force applied during the step
+	//
+	//Returns:
+	//	False at the end of the log
+	bool Next(float &dt, float &externalX, float &externalY);
+
+	///
+	//Closes the file
+	void Close();
+};
+
+#endif //_STEP_LOG_H
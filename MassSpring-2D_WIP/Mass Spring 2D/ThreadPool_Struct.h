@@ -0,0 +1,145 @@
+#ifndef _THREADPOOL_STRUCT_H
+#define _THREADPOOL_STRUCT_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "Profiler.h"
+
+//A persistent pool of worker threads.
+//The workers are created once and sleep between jobs, so dispatching a pass of the solver
+//costs a wakeup rather than a thread creation. The calling thread always takes part in a
+//job as task 0, so a pool of N threads owns N - 1 workers.
+struct ThreadPool
+{
+	int numThreads;						//The number of threads taking part in a job, including the caller
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable start;		//Signalled when a new job is posted
+	std::condition_variable finish;		//Signalled when the last worker finishes a job
+
+	std::function<void(int)> job;		//The job being run
+	int jobTasks;						//The number of tasks in the job being run
+	int remaining;						//The number of worker tasks which have not finished
+	unsigned int generation;			//Incremented for every job so workers can tell it is new
+	bool quit;
+
+	///
+	//Parameterized constructor, starts the workers
+	//
+	//Parameters:
+	//	threads: The number of threads, including the caller (0 for one per hardware thread)
+	ThreadPool(int threads)
+	{
+		if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+		if (threads <= 0) threads = 1;
+
+		numThreads = threads;
+		jobTasks = remaining = 0;
+		generation = 0;
+		quit = false;
+
+		for (int i = 1; i < numThreads; ++i)
+		{
+			workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		start.notify_all();
+
+		for (size_t i = 0; i < workers.size(); ++i)
+		{
+			workers[i].join();
+		}
+	}
+
+	///
+	//Runs task(0) ... task(tasks - 1) in parallel and returns once all of them are done.
+	//The return therefore acts as a barrier between passes.
+	//With more tasks than threads, thread t runs tasks t, t + numThreads, t + 2 * numThreads and so on.
+	//
+	//Parameters:
+	//	tasks: The number of tasks
+	//	task: The function to run, called with the task index
+	void Run(int tasks, const std::function<void(int)> &task)
+	{
+		if (tasks <= 1 || numThreads == 1)
+		{
+			for (int t = 0; t < tasks; ++t) task(t);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = task;
+			jobTasks = tasks;
+			remaining = (tasks < numThreads ? tasks : numThreads) - 1;
+			++generation;
+		}
+		start.notify_all();
+
+		for (int t = 0; t < tasks; t += numThreads) task(t);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		finish.wait(lock, [this] { return remaining == 0; });
+	}
+
+	///
+	//Splits count items into parts contiguous ranges of near equal size
+	//
+	//Parameters:
+	//	count: The number of items
+	//	parts: The number of ranges
+	//	part: The range being requested
+	//	begin: Set to the first item of the range
+	//	end: Set to one past the last item of the range
+	static void Partition(int count, int parts, int part, int &begin, int &end)
+	{
+		int size = count / parts;
+		int extra = count % parts;
+
+		begin = part * size + (part < extra ? part : extra);
+		end = begin + size + (part < extra ? 1 : 0);
+	}
+
+private:
+	///
+	//The loop each worker runs until the pool is destroyed
+	//
+	//Parameters:
+	//	index: The first task index this worker runs
+	void WorkerLoop(int index)
+	{
+		ProfilerSetThreadName("Solver worker");
+
+		unsigned int seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				start.wait(lock, [&] { return quit || generation != seen; });
+				if (quit) return;
+
+				seen = generation;
+				if (index >= jobTasks) continue;
+			}
+
+			for (int t = index; t < jobTasks; t += numThreads) job(t);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--remaining == 0) finish.notify_one();
+		}
+	}
+};
+
+#endif //_THREADPOOL_STRUCT_H
@@ -0,0 +1,351 @@
+/*
+Trajectory recording
+
+The simulation thread and the writer thread share a queue of TRAJECTORY_QUEUE_FRAMES frame buffers.
+Record copies the positions into the next free buffer outside the lock, so the simulation never waits
+on the encoder unless the whole queue is full, and the writer encodes and writes the oldest buffer,
+also outside the lock, before handing it back.
+
+All multi-byte values are written byte by byte in little-endian order, so files move between machines.
+*/
+
+#include "Trajectory.h"
+
+#include <cmath>
+#include <cstring>
+
+//The most bytes a zigzag varint of a 33 bit delta takes
+#define TRAJECTORY_MAX_VARINT 5
+
+///
+//Stores a 32 bit value little-endian
+static void PutU32(unsigned char* out, uint32_t value)
+{
+	for (int i = 0; i < 4; ++i) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+///
+//Loads a little-endian 32 bit value
+static uint32_t GetU32(const unsigned char* in)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < 4; ++i) value |= (uint32_t)in[i] << (8 * i);
+	return value;
+}
+
+///
+//Stores a 64 bit value little-endian
+static void PutU64(unsigned char* out, uint64_t value)
+{
+	for (int i = 0; i < 8; ++i) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+///
+//Loads a little-endian 64 bit value
+static uint64_t GetU64(const unsigned char* in)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < 8; ++i) value |= (uint64_t)in[i] << (8 * i);
+	return value;
+}
+
+///
+//Rounds a coordinate to the nearest quantum, saturating at the ends of the 32 bit range
+//
+//Parameters:
+//	value: The coordinate
+//	invQuantum: The number of quanta per unit length
+static int32_t Quantize(float value, double invQuantum)
+{
+	double q = floor((double)value * invQuantum + 0.5);
+	if (!(q > -2147483647.0)) return -2147483647;	//Also catches NaN
+	if (q > 2147483647.0) return 2147483647;
+	return (int32_t)q;
+}
+
+///
+//Encodes the change of each quantized coordinate of a frame
+//
+//Parameters:
+//	coordinates: The frame's coordinates, count floats
+//	previous: The previous frame's quantized coordinates, updated to this frame's
+//	count: The number of coordinates
+//	keyframe: Whether to store the coordinates themselves rather than their change
+//	invQuantum: The number of quanta per unit length
+//	out: Where to write the varints
+//
+//Returns:
+//	The end of the written varints
+static unsigned char* EncodeCoordinates(const float* coordinates, int32_t* previous, uint32_t count, bool keyframe, double invQuantum, unsigned char* out)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		int32_t q = Quantize(coordinates[i], invQuantum);
+		int64_t delta = keyframe ? (int64_t)q : (int64_t)q - previous[i];
+		previous[i] = q;
+
+		//Zigzag so small negative deltas are small too, then 7 bits per byte, low bits first
+		uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+		while (zigzag >= 0x80)
+		{
+			*out++ = (unsigned char)(zigzag | 0x80);
+			zigzag >>= 7;
+		}
+		*out++ = (unsigned char)zigzag;
+	}
+	return out;
+}
+
+TrajectoryRecorder::TrajectoryRecorder()
+{
+	numParticles = 0;
+	quantum = 0.0f;
+	keyframeInterval = 0;
+	file = nullptr;
+	for (int i = 0; i < TRAJECTORY_QUEUE_FRAMES; ++i)
+	{
+		frames[i] = nullptr;
+		times[i] = 0.0;
+	}
+	head = queued = 0;
+	closing = false;
+	previous = nullptr;
+	encoded = nullptr;
+	framesWritten = bytesWritten = 0;
+	failed = false;
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+	Close();
+}
+
+bool TrajectoryRecorder::Open(const char* path, uint32_t particles, float quantumSize, uint32_t keyframes)
+{
+	Close();
+
+	file = fopen(path, "wb");
+	if (file == nullptr) return false;
+
+	numParticles = particles;
+	quantum = quantumSize;
+	keyframeInterval = keyframes;
+
+	unsigned char header[24];
+	memcpy(header, TRAJECTORY_MAGIC, 8);
+	PutU32(header + 8, TRAJECTORY_VERSION);
+	PutU32(header + 12, numParticles);
+	uint32_t quantumBits;
+	memcpy(&quantumBits, &quantum, 4);
+	PutU32(header + 16, quantumBits);
+	PutU32(header + 20, keyframeInterval);
+	failed = fwrite(header, sizeof(header), 1, file) != 1;
+	bytesWritten = sizeof(header);
+	framesWritten = 0;
+
+	for (int i = 0; i < TRAJECTORY_QUEUE_FRAMES; ++i)
+	{
+		frames[i] = (float*)AlignedAlloc(sizeof(float) * 2 * (size_t)numParticles);
+	}
+	previous = (int32_t*)AlignedAlloc(sizeof(int32_t) * 2 * (size_t)numParticles);
+	encoded = (unsigned char*)AlignedAlloc(16 + (size_t)TRAJECTORY_MAX_VARINT * 2 * numParticles);
+
+	head = queued = 0;
+	closing = false;
+	writer = std::thread(&TrajectoryRecorder::WriterLoop, this);
+	return true;
+}
+
+void TrajectoryRecorder::Record(const ParticleStore &particles, double time)
+{
+	if (file == nullptr) return;
+
+	int slot;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		space.wait(lock, [this] { return queued < TRAJECTORY_QUEUE_FRAMES; });
+		slot = (head + queued) % TRAJECTORY_QUEUE_FRAMES;
+	}
+
+	//The writer does not touch a slot until it has been queued
+	memcpy(frames[slot], particles.x, sizeof(float) * numParticles);
+	memcpy(frames[slot] + numParticles, particles.y, sizeof(float) * numParticles);
+	times[slot] = time;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++queued;
+	}
+	ready.notify_one();
+}
+
+void TrajectoryRecorder::WriterLoop()
+{
+	double invQuantum = 1.0 / quantum;
+
+	for (;;)
+	{
+		int slot;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ready.wait(lock, [this] { return queued > 0 || closing; });
+			if (queued == 0) return;
+			slot = head;
+		}
+
+		if (!failed)
+		{
+			bool keyframe = keyframeInterval == 0 ? framesWritten == 0 : framesWritten % keyframeInterval == 0;
+
+			//Encode behind room for the frame header, then fill it in once the size is known
+			unsigned char* payload = encoded + 16;
+			unsigned char* end = EncodeCoordinates(frames[slot], previous, 2 * numParticles, keyframe, invQuantum, payload);
+			uint32_t payloadBytes = (uint32_t)(end - payload);
+
+			uint64_t timeBits;
+			memcpy(&timeBits, &times[slot], 8);
+			PutU32(encoded, payloadBytes);
+			PutU32(encoded + 4, keyframe ? TRAJECTORY_KEYFRAME : 0u);
+			PutU64(encoded + 8, timeBits);
+
+			size_t bytes = 16 + (size_t)payloadBytes;
+			if (fwrite(encoded, 1, bytes, file) == bytes)
+			{
+				bytesWritten += bytes;
+				++framesWritten;
+			}
+			else
+			{
+				failed = true;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			head = (head + 1) % TRAJECTORY_QUEUE_FRAMES;
+			--queued;
+		}
+		space.notify_one();
+	}
+}
+
+bool TrajectoryRecorder::Close()
+{
+	if (file == nullptr) return true;
+
+	//The writer drains the queue before it sees closing with nothing left
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	ready.notify_one();
+	writer.join();
+
+	if (fclose(file) != 0) failed = true;
+	file = nullptr;
+
+	for (int i = 0; i < TRAJECTORY_QUEUE_FRAMES; ++i)
+	{
+		AlignedFree(frames[i]);
+		frames[i] = nullptr;
+	}
+	AlignedFree(previous);
+	AlignedFree(encoded);
+	previous = nullptr;
+	encoded = nullptr;
+
+	return !failed;
+}
+
+TrajectoryReader::TrajectoryReader()
+{
+	memset(&header, 0, sizeof(header));
+	file = nullptr;
+	current = nullptr;
+	encoded = nullptr;
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+	Close();
+}
+
+bool TrajectoryReader::Open(const char* path)
+{
+	Close();
+
+	file = fopen(path, "rb");
+	if (file == nullptr) return false;
+
+	unsigned char bytes[24];
+	if (fread(bytes, sizeof(bytes), 1, file) != 1 || memcmp(bytes, TRAJECTORY_MAGIC, 8) != 0 || GetU32(bytes + 8) != TRAJECTORY_VERSION)
+	{
+		Close();
+		return false;
+	}
+
+	memcpy(header.magic, bytes, 8);
+	header.version = GetU32(bytes + 8);
+	header.numParticles = GetU32(bytes + 12);
+	uint32_t quantumBits = GetU32(bytes + 16);
+	memcpy(&header.quantum, &quantumBits, 4);
+	header.keyframeInterval = GetU32(bytes + 20);
+
+	current = (int32_t*)AlignedAlloc(sizeof(int32_t) * 2 * (size_t)header.numParticles);
+	encoded = (unsigned char*)AlignedAlloc((size_t)TRAJECTORY_MAX_VARINT * 2 * header.numParticles);
+	return true;
+}
+
+bool TrajectoryReader::ReadFrame(float* x, float* y, double &time)
+{
+	if (file == nullptr) return false;
+
+	unsigned char frameHeader[16];
+	if (fread(frameHeader, sizeof(frameHeader), 1, file) != 1) return false;
+
+	uint32_t payloadBytes = GetU32(frameHeader);
+	bool keyframe = (GetU32(frameHeader + 4) & TRAJECTORY_KEYFRAME) != 0;
+	uint64_t timeBits = GetU64(frameHeader + 8);
+	memcpy(&time, &timeBits, 8);
+
+	uint32_t count = 2 * header.numParticles;
+	if (payloadBytes > (size_t)TRAJECTORY_MAX_VARINT * count) return false;
+	if (payloadBytes > 0 && fread(encoded, payloadBytes, 1, file) != 1) return false;
+
+	//Undo the varints and the deltas
+	const unsigned char* in = encoded;
+	const unsigned char* end = encoded + payloadBytes;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint64_t zigzag = 0;
+		int shift = 0;
+		for (;;)
+		{
+			if (in == end || shift > 63) return false;
+			unsigned char byte = *in++;
+			zigzag |= (uint64_t)(byte & 0x7f) << shift;
+			shift += 7;
+			if ((byte & 0x80) == 0) break;
+		}
+		int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+		current[i] = (int32_t)(keyframe ? delta : current[i] + delta);
+	}
+
+	float q = header.quantum;
+	for (uint32_t i = 0; i < header.numParticles; ++i)
+	{
+		x[i] = (float)((double)current[i] * q);
+		y[i] = (float)((double)current[header.numParticles + i] * q);
+	}
+	return true;
+}
+
+void TrajectoryReader::Close()
+{
+	if (file != nullptr) fclose(file);
+	file = nullptr;
+	AlignedFree(current);
+	AlignedFree(encoded);
+	current = nullptr;
+	encoded = nullptr;
+}
@@ -0,0 +1,155 @@
+#ifndef _TRAJECTORY_H
+#define _TRAJECTORY_H
+
+#include "ParticleStore_Struct.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+//Recording of every particle's position at every step, for offline analysis.
+//
+//Positions are quantized to a fixed grid, then each frame stores the change of every quantized
+//coordinate since the previous frame as a zigzag varint, so a particle that moved less than 64
+//quanta costs one byte per coordinate rather than four. Every keyframe interval a frame stores the
+//coordinates themselves instead, so a reader can start from the nearest keyframe. Because the deltas
+//are taken between quantized values, the error never accumulates: every decoded position is within
+//half a quantum of the simulated one, give or take float rounding.
+//
+//File layout, little-endian:
+//	TrajectoryHeader
+//	per frame:
+//		uint32 payload bytes, uint32 flags (TRAJECTORY_KEYFRAME), float64 time
+//		payload: numParticles x deltas, then numParticles y deltas, each a zigzag LEB128 varint
+
+#define TRAJECTORY_MAGIC "MSPRTRAJ"
+#define TRAJECTORY_VERSION 1
+
+//Frame flag: the payload holds the quantized coordinates rather than deltas
+#define TRAJECTORY_KEYFRAME 1u
+
+//The number of frames the recorder buffers between the simulation and the writer thread
+#define TRAJECTORY_QUEUE_FRAMES 4
+
+//The start of a trajectory file. Every field is little-endian.
+struct TrajectoryHeader
+{
+	char magic[8];				//TRAJECTORY_MAGIC, not null terminated
+	uint32_t version;			//TRAJECTORY_VERSION of the writer
+	uint32_t numParticles;
+	float quantum;				//The size of one quantization step
+	uint32_t keyframeInterval;	//Every this many frames is a keyframe, starting with the first
+};
+
+//Streams particle positions to a trajectory file from a background thread.
+//The simulation thread only copies the positions into a free frame of a small queue; quantizing,
+//encoding and writing happen on the writer thread. If the writer falls behind, Record waits for a
+//free frame rather than dropping one, so the file always holds every recorded step.
+struct TrajectoryRecorder
+{
+	uint32_t numParticles;
+	float quantum;
+	uint32_t keyframeInterval;
+
+	FILE* file;
+	std::thread writer;
+
+	//The queue, guarded by mutex
+	std::mutex mutex;
+	std::condition_variable ready;		//Signalled when a frame is queued or the recorder closes
+	std::condition_variable space;		//Signalled when the writer frees a frame
+	float* frames[TRAJECTORY_QUEUE_FRAMES];	//Per frame: numParticles x then numParticles y
+	double times[TRAJECTORY_QUEUE_FRAMES];
+	int head;							//The oldest queued frame
+	int queued;							//The number of queued frames
+	bool closing;
+
+	//Owned by the writer thread until Close returns
+	int32_t* previous;					//The quantized coordinates of the last frame written
+	unsigned char* encoded;				//Scratch space for one encoded frame
+	uint64_t framesWritten;
+	uint64_t bytesWritten;
+	bool failed;						//Whether a write failed; later frames are discarded
+
+	///
+	//Default constructor, records nothing until Open is called
+	TrajectoryRecorder();
+	~TrajectoryRecorder();
+
+	///
+	//Creates a trajectory file and starts the writer thread
+	//
+	//Parameters:
+	//	path: The file to write, replaced if it exists
+	//	particles: The number of particles each frame holds
+	//	quantumSize: The size of one quantization step, the largest error allowed is half of it
+	//	keyframes: Every this many frames is a keyframe (0 for only the first)
+	//
+	//Returns:
+	//	False if the file could not be created
+	bool Open(const char* path, uint32_t particles, float quantumSize, uint32_t keyframes);
+
+	///
+	//Queues the current positions of the particles as the next frame.
+	//Waits if the queue is full.
+	//
+	//Parameters:
+	//	particles: The particles to record, numParticles of them
+	//	time: The simulated time of the frame
+	void Record(const ParticleStore &particles, double time);
+
+	///
+	//Writes every queued frame, stops the writer thread and closes the file
+	//
+	//Returns:
+	//	False if any write failed
+	bool Close();
+
+	///
+	//The writer thread: encodes and writes queued frames until the recorder closes
+	void WriterLoop();
+};
+
+//Reads a trajectory file frame by frame
+struct TrajectoryReader
+{
+	TrajectoryHeader header;
+	FILE* file;
+	int32_t* current;					//The quantized coordinates of the last frame read
+	unsigned char* encoded;				//Scratch space for one encoded frame
+
+	///
+	//Default constructor, reads nothing until Open is called
+	TrajectoryReader();
+	~TrajectoryReader();
+
+	///
+	//Opens a trajectory file and reads its header
+	//
+	//Parameters:
+	//	path: The file to read
+	//
+	//Returns:
+	//	False if the file could not be read or is not a trajectory this version understands
+	bool Open(const char* path);
+
+	///
+	//Decodes the next frame
+	//
+	//Parameters:
+	//	x: Set to the x coordinate of every particle, header.numParticles floats
+	//	y: Set to the y coordinate of every particle
+	//	time: Set to the simulated time of the frame
+	//
+	//Returns:
+	//	False at the end of the file or if the frame is damaged
+	bool ReadFrame(float* x, float* y, double &time);
+
+	///
+	//Closes the file
+	void Close();
+};
+
+#endif //_TRAJECTORY_H
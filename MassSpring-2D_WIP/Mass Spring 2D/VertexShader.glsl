@@ -48,7 +48,7 @@ Base by Srinivasan Thiagarajan
 
 #version 400 core // Identifies the version of the shader, this line must be on a separate line from the rest of the shader code
  
-layout(location = 0) in vec3 in_position;	// Get in a vec3 for position
+layout(location = 0) in vec2 in_position;	// Get in a vec2 for position, the z of a 2D mesh is always 0
 layout(location = 1) in vec4 in_color;		// Get in a vec4 for color
 
 out vec4 color; // Our vec4 color variable containing r, g, b, a
@@ -58,5 +58,5 @@ uniform mat4 MVP; // Our uniform MVP matrix to modify our position values
 void main(void)
 {
 	color = in_color;	// Pass the color through
-	gl_Position = MVP * vec4(in_position, 1.0); //w is 1.0, also notice cast to a vec4
+	gl_Position = MVP * vec4(in_position, 0.0, 1.0); //z is 0.0 and w is 1.0, also notice cast to a vec4
 }
\ No newline at end of file
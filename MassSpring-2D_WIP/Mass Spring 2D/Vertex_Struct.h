@@ -2,11 +2,12 @@
 #define _VERTEX_STRUCT_H
 
 
+//A vertex of a 2D mesh; its z is always 0 and is not stored
 struct Vertex
 {
 	float
-		x, y, z,
+		x, y,
 		r, g, b, a;
 };
 
-#endif __VERTEX_STRUCT_H
+#endif //_VERTEX_STRUCT_H
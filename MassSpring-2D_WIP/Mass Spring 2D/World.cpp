@@ -0,0 +1,287 @@
+/*
+World
+
+The flat pass gives each task a contiguous run of the batched bodies whose particle counts add up to
+about an equal share. The bodies start on cache lines, so two threads never write the same line even
+when their bodies are neighbours in memory.
+
+A body is batched or not depending only on its size and integrator, never on the thread count, so the
+order each body's forces are summed in, and therefore its trajectory, is the same on any machine.
+*/
+
+#include "World.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+///
+//Rounds a count up to the next multiple of WORLD_ALIGNMENT
+static unsigned int AlignCount(unsigned int count)
+{
+	return (count + (unsigned int)WORLD_ALIGNMENT - 1) & ~((unsigned int)WORLD_ALIGNMENT - 1);
+}
+
+World::World()
+{
+	hugePages = false;
+	cgIterations = 0;
+	contacts = 0;
+	awakeTiles = 0;
+}
+
+World::~World()
+{
+	Release();
+}
+
+void World::Pack(const std::vector<const SoftBody*> &sources)
+{
+	Release();
+
+	unsigned int numParticles = 0;
+	unsigned int numSprings = 0;
+	for (size_t i = 0; i < sources.size(); ++i)
+	{
+		WorldBody* body = new WorldBody();
+		body->firstParticle = numParticles;
+		body->firstSpring = numSprings;
+		body->integrator = -1;
+		bodies.push_back(body);
+
+		numParticles += AlignCount(sources[i]->numParticles);
+		numSprings += AlignCount(sources[i]->springs.count);
+	}
+
+	//The padding is zeroed and belongs to no body, so nothing ever moves it or reads it
+	arena.Reserve(ParticleStore::ArenaSize(numParticles) + SpringTable::ArenaSize(numSprings), hugePages);
+	particles.Allocate(numParticles, arena);
+	springs.Allocate(numSprings, arena);
+	springs.count = numSprings;
+
+	for (size_t i = 0; i < sources.size(); ++i)
+	{
+		const SoftBody &source = *sources[i];
+		WorldBody &body = *bodies[i];
+		unsigned int p = body.firstParticle;
+		unsigned int s = body.firstSpring;
+		size_t particleBytes = sizeof(float) * source.numParticles;
+		size_t springBytes = sizeof(float) * source.springs.count;
+
+		memcpy(particles.x + p, source.particles.x, particleBytes);
+		memcpy(particles.y + p, source.particles.y, particleBytes);
+		memcpy(particles.vx + p, source.particles.vx, particleBytes);
+		memcpy(particles.vy + p, source.particles.vy, particleBytes);
+		memcpy(particles.invMass + p, source.particles.invMass, particleBytes);
+
+		memcpy(springs.a + s, source.springs.a, springBytes);
+		memcpy(springs.b + s, source.springs.b, springBytes);
+		memcpy(springs.restLength + s, source.springs.restLength, springBytes);
+		memcpy(springs.stiffness + s, source.springs.stiffness, springBytes);
+
+		SoftBody &view = body.view;
+		view.subdivisionsX = source.subdivisionsX;
+		view.subdivisionsY = source.subdivisionsY;
+		view.restWidth = source.restWidth;
+		view.restHeight = source.restHeight;
+		view.coefficient = source.coefficient;
+		view.dampening = source.dampening;
+		view.numParticles = source.numParticles;
+		view.particles.Borrow(particles, p, source.numParticles);
+		view.springs.Borrow(springs, s, source.springs.count);
+	}
+}
+
+void World::Adopt(SoftBody &source)
+{
+	Release();
+
+	WorldBody* body = new WorldBody();
+	body->firstParticle = 0;
+	body->firstSpring = 0;
+	body->integrator = -1;
+	bodies.push_back(body);
+
+	particles.Borrow(source.particles, 0, source.numParticles);
+	springs.Borrow(source.springs, 0, source.springs.count);
+
+	SoftBody &view = body->view;
+	view.subdivisionsX = source.subdivisionsX;
+	view.subdivisionsY = source.subdivisionsY;
+	view.restWidth = source.restWidth;
+	view.restHeight = source.restHeight;
+	view.coefficient = source.coefficient;
+	view.dampening = source.dampening;
+	view.numParticles = source.numParticles;
+	view.particles.Borrow(particles, 0, source.numParticles);
+	view.springs.Borrow(springs, 0, source.springs.count);
+}
+
+void World::Step(SoftBodySolver &solver, float dt, float externalX, float externalY)
+{
+	PROFILE_ZONE("World step");
+	ThreadPool &pool = *solver.pool;
+
+	//Pick out the bodies for the flat pass
+	batch.clear();
+	batchEnds.clear();
+	unsigned long long batched = 0;
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		const WorldBody &body = *bodies[i];
+		IntegratorType integrator = body.integrator < 0 ? solver.integrator : (IntegratorType)body.integrator;
+		if (integrator == INTEGRATOR_EXPLICIT_EULER && body.view.numParticles <= WORLD_BATCH_MAX_PARTICLES)
+		{
+			batched += body.view.numParticles;
+			batch.push_back((unsigned int)i);
+			batchEnds.push_back(batched);
+		}
+	}
+
+	bool sleeping = solver.sleepThreshold > 0.0f;
+	if (!batch.empty())
+	{
+		int tasks = pool.numThreads < (int)batch.size() ? pool.numThreads : (int)batch.size();
+		pool.Run(tasks, [&](int task)
+		{
+			PROFILE_ZONE("World batch");
+
+			//The bodies whose particles end inside this task's share
+			unsigned long long shareBegin = batched * task / tasks;
+			unsigned long long shareEnd = batched * (task + 1) / tasks;
+			size_t begin = std::upper_bound(batchEnds.begin(), batchEnds.end(), shareBegin) - batchEnds.begin();
+			size_t end = std::upper_bound(batchEnds.begin(), batchEnds.end(), shareEnd) - batchEnds.begin();
+
+			for (size_t n = begin; n < end; ++n)
+			{
+				WorldBody &worldBody = *bodies[batch[n]];
+				SoftBody &body = worldBody.view;
+				ParticleStore &p = body.particles;
+				SleepSystem &sleep = worldBody.sleep;
+
+				//The whole body is one band, so every spring is scattered to both ends at once
+				if (sleeping)
+				{
+					PrepareSleep(body, sleep, externalX, externalY, solver.sleepThreshold);
+					ApplyActiveSpringForces(body, sleep, solver.kernel, 0, sleep.tilesY);
+				}
+				else
+				{
+					ApplySpringForces(body, solver.kernel, 0, body.subdivisionsY);
+				}
+
+				for (int j = 0; j < body.subdivisionsX; ++j)
+				{
+					p.fx[j] += externalX;
+					p.fy[j] += externalY;
+				}
+
+				if (sleeping) IntegrateAwake(dt, body, sleep, 0, sleep.tilesY, solver.sleepThreshold, solver.sleepSteps);
+				else IntegrateLinear(dt, p, 0, body.numParticles);
+			}
+		});
+	}
+
+	//Everything else goes through the banded passes one body at a time
+	cgIterations = 0;
+	size_t next = 0;
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		if (next < batch.size() && batch[next] == i)
+		{
+			++next;
+			continue;
+		}
+
+		WorldBody &body = *bodies[i];
+		SoftBody &view = body.view;
+		IntegratorType integrator = body.integrator < 0 ? solver.integrator : (IntegratorType)body.integrator;
+		switch (integrator)
+		{
+		case INTEGRATOR_IMPLICIT_EULER:
+			cgIterations += StepImplicitEuler(view, body.implicit, pool, solver.NumBands(view), solver.kernel, dt, externalX, externalY,
+				solver.cgMaxIterations, solver.cgTolerance);
+			break;
+		case INTEGRATOR_XPBD:
+			if (StepXPBD(view, body.xpbd, pool, solver.NumBands(view), dt, externalX, externalY, solver.xpbdIterations)) break;
+			//Springs too tangled to colour are stepped with explicit Euler instead
+			//Falls through
+		default:
+			if (sleeping)
+			{
+				StepSleepingExplicitEuler(view, body.sleep, pool, solver.NumBands(view), solver.kernel, dt, externalX, externalY,
+					solver.sleepThreshold, solver.sleepSteps);
+				break;
+			}
+			solver.SolveSprings(view);
+			solver.Integrate(view, dt, externalX, externalY);
+			break;
+		}
+	}
+
+	awakeTiles = 0;
+	if (sleeping)
+	{
+		for (size_t i = 0; i < bodies.size(); ++i)
+		{
+			awakeTiles += bodies[i]->sleep.awakeTiles;
+		}
+	}
+
+	contacts = 0;
+	if (solver.collisionRadius > 0.0f)
+	{
+		PROFILE_ZONE("Self-collision");
+		for (size_t i = 0; i < bodies.size(); ++i)
+		{
+			WorldBody &body = *bodies[i];
+			contacts += SolveSelfCollisions(body.view.particles, body.collision, pool, pool.numThreads, solver.collisionRadius);
+			if (sleeping) WakeCollidedTiles(body.view, body.sleep, body.collision);
+		}
+	}
+}
+
+///
+//Folds a block of bytes into an FNV-1a hash
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+uint64_t World::StateHash() const
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		const ParticleStore &p = bodies[i]->view.particles;
+		size_t bytes = sizeof(float) * bodies[i]->view.numParticles;
+		hash = HashBytes(hash, p.x, bytes);
+		hash = HashBytes(hash, p.y, bytes);
+		hash = HashBytes(hash, p.vx, bytes);
+		hash = HashBytes(hash, p.vy, bytes);
+	}
+	return hash;
+}
+
+void World::Release()
+{
+	//The views borrow the shared arrays, so they go first
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		delete bodies[i];
+	}
+	bodies.clear();
+
+	//Whatever the size of the world, the arrays go back to the arena at once
+	particles.Release();
+	springs.Release();
+	arena.Reset();
+	cgIterations = 0;
+	contacts = 0;
+	awakeTiles = 0;
+}
@@ -0,0 +1,109 @@
+#ifndef _WORLD_H
+#define _WORLD_H
+
+#include "SoftBodySolver.h"
+
+#include <cstdint>
+#include <vector>
+
+//Many softbodies packed into one particle store and one spring table.
+//
+//Each body's particles and springs are a contiguous range of the shared arrays, starting on a cache
+//line, and each spring keeps particle indices relative to its own body. A body is still a SoftBody:
+//its view borrows its ranges, so anything written for a single softbody (snapshots, trajectories,
+//the integrators) works on it unchanged and sees the shared data.
+//
+//Stepping runs every small explicit Euler body in one flat pass: the bodies are dealt out to the
+//threads whole, balanced by particle count, and each thread solves the springs of and integrates its
+//bodies back to back. That is one dispatch for hundreds of cloths, rather than three per cloth, and
+//since no body is split there is no boundary pass. Bodies too large to balance that way, and bodies
+//using another integrator, are stepped one at a time across all threads as SoftBodySolver would.
+//
+//The shared arrays are taken from one arena block, optionally of huge pages, which the world keeps
+//when it is emptied: packing a scene again of the same size or smaller reuses it without allocating.
+
+//Particles and springs per cache line: every body's ranges start on a multiple of this
+#define WORLD_ALIGNMENT (CACHE_LINE_SIZE / sizeof(float))
+
+//Bodies with more particles than this are split into bands of rows rather than batched whole
+#define WORLD_BATCH_MAX_PARTICLES 16384
+
+//One softbody of a world
+struct WorldBody
+{
+	unsigned int firstParticle;		//Where the body's particles start in the world's store
+	unsigned int firstSpring;		//Where the body's springs start in the world's table
+	int integrator;					//An IntegratorType, or -1 to use the solver's
+	struct SoftBody view;			//The body, borrowing its ranges of the world's arrays
+
+	//Working storage of the integrators that keep some between steps
+	struct ImplicitSystem implicit;
+	struct XPBDSystem xpbd;
+	struct CollisionSystem collision;
+	struct SleepSystem sleep;
+};
+
+//A set of softbodies stepped and drawn together
+struct World
+{
+	struct Arena arena;					//Holds the particles and springs
+	bool hugePages;						//Whether Pack asks for huge pages for the arena
+	struct ParticleStore particles;		//Every body's particles, padded so each body starts on a cache line
+	struct SpringTable springs;			//Every body's springs, likewise padded
+	std::vector<WorldBody*> bodies;
+
+	int cgIterations;					//Implicit Euler: the iterations of every body in the last step
+	unsigned int contacts;				//Self-collision: the contacts of every body in the last step
+	unsigned int awakeTiles;			//Sleeping: the tiles of every explicit Euler body awake in the last step
+
+	std::vector<unsigned int> batch;	//Scratch: the bodies of the flat pass
+	std::vector<unsigned long long> batchEnds;	//Scratch: the running particle count at the end of each
+
+	///
+	//Default constructor, creates an empty world
+	World();
+	~World();
+
+	///
+	//Copies softbodies into the world, replacing any it held
+	//
+	//Parameters:
+	//	sources: The softbodies to pack, which are not changed or kept
+	void Pack(const std::vector<const SoftBody*> &sources);
+
+	///
+	//Makes a single softbody the world's only body without copying it, replacing any bodies it held.
+	//The world borrows the body's arrays, so a body restored from a snapshot keeps stepping in its
+	//mapping rather than in the arena; hugePages has no effect.
+	//
+	//Parameters:
+	//	source: The softbody to step, which must outlive the world or its next Pack, Adopt or Release
+	void Adopt(SoftBody &source);
+
+	///
+	//Advances every body by one timestep, then resolves each body's self-collisions if they are enabled.
+	//Uses the solver's threads, kernel and settings, and its integrator for bodies without their own.
+	//With a sleep threshold, each explicit Euler body keeps its own sleep state.
+	//
+	//Parameters:
+	//	solver: The solver to step with
+	//	dt: The timestep
+	//	externalX: X component of the external force applied to each body's bottom row
+	//	externalY: Y component of the external force applied to each body's bottom row
+	void Step(SoftBodySolver &solver, float dt, float externalX, float externalY);
+
+	///
+	//Hashes the positions and velocities of every body, for checking that two runs reached the same
+	//state bit for bit. The padding between bodies is left out, so the hash only depends on the bodies.
+	//
+	//Returns:
+	//	The 64 bit FNV-1a hash of each body's x, y, vx and vy arrays in turn
+	uint64_t StateHash() const;
+
+	///
+	//Frees every body and gives the shared arrays back to the arena, which keeps its block for the
+	//next Pack; the block itself is freed with the world
+	void Release();
+};
+
+#endif //_WORLD_H
@@ -0,0 +1,142 @@
+/*
+XPBD integrator
+
+Extended position based dynamics (Macklin, Mueller & Chentanez, "XPBD: Position-Based Simulation of
+Compliant Constrained Dynamics") treats every spring as a distance constraint
+
+	C = |Xb - Xa| - rest
+
+with compliance alpha = 1 / k, the inverse of the spring coefficient. Each step:
+	1. Apply the external force and dampening to the velocities and predict the positions
+	2. Repeatedly project every constraint, accumulating its Lagrange multiplier lambda:
+		dLambda = (-C - alpha~ * lambda) / (wa + wb + alpha~),    alpha~ = alpha / h^2
+		Xa -= wa * dLambda * n,  Xb += wb * dLambda * n
+	3. Derive the velocities from the change in position
+
+Unlike Hooke's law integrated explicitly, the projection is unconditionally stable, and because the
+compliance is scaled by h^2 the resulting stiffness does not depend on the timestep or the iteration
+count. The springs are projected one colour at a time; no two springs of a colour share a particle,
+so each colour is split across the worker threads with no write conflicts and no dependence of the
+result on the number of threads.
+
+The dampening matches the other integrators, -C * V per attached spring, and is applied implicitly so
+it cannot overshoot at large steps.
+*/
+
+#include "SoftBodySolver.h"
+
+#include <cmath>
+
+bool StepXPBD(SoftBody &body, XPBDSystem &system, ThreadPool &pool, int bands, float dt, float externalX, float externalY, int iterations)
+{
+	ParticleStore &p = body.particles;
+	const SpringTable &springs = body.springs;
+	XPBDSystem &sys = system;
+	int width = body.subdivisionsX;
+	int height = body.subdivisionsY;
+	float h = dt;
+
+	if (!sys.Resize(body.numParticles, springs)) return false;
+
+	//Predict positions from the external force and dampening
+	pool.Run(bands, [&](int band)
+	{
+		int firstRow, endRow;
+		ThreadPool::Partition(height, bands, band, firstRow, endRow);
+		unsigned int first = firstRow * width;
+		unsigned int end = endRow * width;
+
+		for (unsigned int i = first; i < end; ++i)
+		{
+			float w = p.invMass[i];
+			float fx = p.fx[i];
+			float fy = p.fy[i];
+			if (i < (unsigned int)width)
+			{
+				fx += externalX;
+				fy += externalY;
+			}
+
+			//Implicit dampening: V' = (V + h*w*F) / (1 + h*w*C*degree)
+			float damp = 1.0f / (1.0f + h * w * body.dampening * sys.degree[i]);
+			p.vx[i] = (p.vx[i] + h * w * fx) * damp;
+			p.vy[i] = (p.vy[i] + h * w * fy) * damp;
+
+			sys.prevX[i] = p.x[i];
+			sys.prevY[i] = p.y[i];
+			p.x[i] += h * p.vx[i];
+			p.y[i] += h * p.vy[i];
+
+			//Zero the net force!
+			p.fx[i] = p.fy[i] = 0.0f;
+		}
+	});
+
+	memset(sys.lambda, 0, sizeof(float) * sys.numSprings);
+
+	//Project the constraints, one colour at a time
+	float invH2 = 1.0f / (h * h);
+	for (int iteration = 0; iteration < iterations; ++iteration)
+	{
+		for (unsigned int c = 0; c < sys.numColors; ++c)
+		{
+			unsigned int colorBegin = sys.colorStart[c];
+			int colorSize = (int)(sys.colorStart[c + 1] - colorBegin);
+			int tasks = pool.numThreads < colorSize ? pool.numThreads : colorSize;
+
+			pool.Run(tasks, [&](int task)
+			{
+				int begin, end;
+				ThreadPool::Partition(colorSize, tasks, task, begin, end);
+
+				for (int k = begin; k < end; ++k)
+				{
+					unsigned int s = sys.order[colorBegin + k];
+					float stiffness = springs.stiffness[s];
+					if (stiffness <= 0.0f) continue;
+
+					unsigned int a = springs.a[s];
+					unsigned int b = springs.b[s];
+					float wa = p.invMass[a];
+					float wb = p.invMass[b];
+
+					float dx = p.x[b] - p.x[a];
+					float dy = p.y[b] - p.y[a];
+					float len = sqrtf(dx * dx + dy * dy);
+					if (len <= 0.0f) continue;
+
+					float alpha = invH2 / stiffness;
+					float denominator = wa + wb + alpha;
+					if (denominator <= 0.0f) continue;
+
+					float constraint = len - springs.restLength[s];
+					float dLambda = (-constraint - alpha * sys.lambda[s]) / denominator;
+					sys.lambda[s] += dLambda;
+
+					float nx = dx / len;
+					float ny = dy / len;
+					p.x[a] -= wa * dLambda * nx;
+					p.y[a] -= wa * dLambda * ny;
+					p.x[b] += wb * dLambda * nx;
+					p.y[b] += wb * dLambda * ny;
+				}
+			});
+		}
+	}
+
+	//The velocity is whatever moved the particle over the step
+	float invH = 1.0f / h;
+	pool.Run(bands, [&](int band)
+	{
+		int firstRow, endRow;
+		ThreadPool::Partition(height, bands, band, firstRow, endRow);
+
+		for (unsigned int i = firstRow * width; i < (unsigned int)(endRow * width); ++i)
+		{
+			p.vx[i] = (p.x[i] - sys.prevX[i]) * invH;
+			p.vy[i] = (p.y[i] - sys.prevY[i]) * invH;
+		}
+	});
+
+	return true;
+}
@@ -0,0 +1,139 @@
+#ifndef _XPBDSYSTEM_STRUCT_H
+#define _XPBDSYSTEM_STRUCT_H
+
+#include "AlignedMemory.h"
+#include "SpringTable_Struct.h"
+
+//The most colours the spring graph may need. A lattice needs 4.
+#define XPBD_MAX_COLORS 32
+
+//Working storage for the XPBD (extended position based dynamics) integrator.
+//The springs are split into colours such that no two springs of the same colour share a particle,
+//so all springs of one colour can be projected at the same time without any write conflicts,
+//and the result does not depend on how a colour is divided among threads.
+struct XPBDSystem
+{
+	unsigned int numParticles;		//The number of particles the per-particle arrays have room for
+	unsigned int numSprings;		//The number of springs the per-spring arrays have room for
+	const unsigned int* topology;	//The spring table the colouring was built from
+	bool colored;					//Whether the colouring fitted in XPBD_MAX_COLORS colours
+
+	float* prevX;					//Per particle: position at the start of the step
+	float* prevY;
+	float* degree;					//Per particle: the number of springs attached, which scales the dampening
+
+	float* lambda;					//Per spring: the accumulated Lagrange multiplier of the step
+
+	unsigned int numColors;							//The number of colours used
+	unsigned int colorStart[XPBD_MAX_COLORS + 1];	//Colour c is order[colorStart[c]] ... order[colorStart[c + 1] - 1]
+	unsigned int* order;							//Spring indices sorted by colour
+
+	///
+	//Default constructor, creates an empty system
+	XPBDSystem()
+	{
+		numParticles = numSprings = numColors = 0;
+		topology = nullptr;
+		colored = false;
+		prevX = prevY = degree = lambda = nullptr;
+		order = nullptr;
+	}
+
+	~XPBDSystem()
+	{
+		Release();
+	}
+
+	///
+	//Makes room for the given softbody's particles and springs, counts the springs on each particle and
+	//colours the springs. Only reports the last result if the system was last sized for the same spring
+	//table, so a table that could not be coloured keeps failing rather than reusing a bad colouring.
+	//
+	//Parameters:
+	//	particles: The number of particles in the softbody
+	//	springs: The softbody's springs
+	//
+	//Returns:
+	//	False if the springs need more than XPBD_MAX_COLORS colours
+	bool Resize(unsigned int particles, const SpringTable &springs)
+	{
+		if (particles == numParticles && springs.count == numSprings && springs.a == topology) return colored;
+
+		Release();
+		numParticles = particles;
+		numSprings = springs.count;
+		topology = springs.a;
+
+		prevX = (float*)AlignedAlloc(sizeof(float) * numParticles);
+		prevY = (float*)AlignedAlloc(sizeof(float) * numParticles);
+		degree = (float*)AlignedAlloc(sizeof(float) * numParticles);
+		lambda = (float*)AlignedAlloc(sizeof(float) * numSprings);
+		order = (unsigned int*)AlignedAlloc(sizeof(unsigned int) * numSprings);
+
+		//Greedy colouring: each spring takes the lowest colour not yet used at either endpoint
+		unsigned int* used = (unsigned int*)AlignedAlloc(sizeof(unsigned int) * numParticles);
+		unsigned char* color = (unsigned char*)AlignedAlloc(numSprings);
+		unsigned int count[XPBD_MAX_COLORS] = { 0 };
+		bool ok = true;
+
+		for (unsigned int s = 0; s < numSprings; ++s)
+		{
+			unsigned int a = springs.a[s];
+			unsigned int b = springs.b[s];
+			degree[a] += 1.0f;
+			degree[b] += 1.0f;
+
+			unsigned int free = ~(used[a] | used[b]);
+			unsigned int c = 0;
+			while (c < XPBD_MAX_COLORS && (free & (1u << c)) == 0) ++c;
+			if (c == XPBD_MAX_COLORS)
+			{
+				ok = false;
+				c = 0;
+			}
+
+			used[a] |= 1u << c;
+			used[b] |= 1u << c;
+			color[s] = (unsigned char)c;
+			++count[c];
+			if (c + 1 > numColors) numColors = c + 1;
+		}
+
+		//Counting sort of the springs by colour, keeping table order within a colour
+		colorStart[0] = 0;
+		for (unsigned int c = 0; c < XPBD_MAX_COLORS; ++c)
+		{
+			colorStart[c + 1] = colorStart[c] + count[c];
+		}
+		unsigned int next[XPBD_MAX_COLORS];
+		memcpy(next, colorStart, sizeof(next));
+		for (unsigned int s = 0; s < numSprings; ++s)
+		{
+			order[next[color[s]]++] = s;
+		}
+
+		AlignedFree(used);
+		AlignedFree(color);
+		colored = ok;
+		return ok;
+	}
+
+	///
+	//Frees all arrays
+	void Release()
+	{
+		AlignedFree(prevX);
+		AlignedFree(prevY);
+		AlignedFree(degree);
+		AlignedFree(lambda);
+		AlignedFree(order);
+
+		prevX = prevY = degree = lambda = nullptr;
+		order = nullptr;
+		numParticles = numSprings = numColors = 0;
+		topology = nullptr;
+		colored = false;
+	}
+};
+
+#endif //_XPBDSYSTEM_STRUCT_H
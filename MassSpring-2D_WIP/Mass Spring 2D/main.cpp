@@ -25,6 +25,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 Description:
 This is a demonstration of using mass spring systems to simulate soft body physics.
 The demo contains a blue cloth made of a 10x10 grid of masses with springs connecting them.
+The cloths are described by a scene file, ../Scene.txt unless another is given on the command line;
+see Scene.h for its settings. Passing --trace FILE writes a Chrome trace of the last frames on exit.
+--metrics FILE rewrites FILE with the runtime metrics every second, and --metrics-port N serves them
+at http://127.0.0.1:N/metrics. --step-log FILE logs every step and the input during it, for
+MassSpringHeadless --replay to reproduce the session.
 
 Each physics timestep the mass spring system is solved to determine the force on each
 individual point mass in the system. This is done using Hooke's law. The springs also contain 
@@ -47,22 +52,64 @@ PhysicsTimestep by Brockton Roth
 Base by Srinivasan Thiagarajan
 */
 
+#include "GLRender.h"
+#include "Vertex_Struct.h"
+#include "Mesh_Struct.h"
+#include "SoftBodySolver.h"
+#include "SnapshotBuffer_Struct.h"
+#include "Scene.h"
+#include "World.h"
+#include "LatticeMesh.h"
+#include "Profiler.h"
+#include "MetricsExporter.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+//The scene being simulated
+Scene scene;
+
+//Every lattice of the scene, packed together so they are stepped in one pass and drawn in one call
+struct World* world;
+struct Mesh* lattice;
 
+//Steps the world across all hardware threads with the widest spring kernel this CPU supports
+struct SoftBodySolver* solver;
 
+//Physics runs on its own thread and hands finished positions to the render loop through here.
+//Each snapshot holds the positions before and after the last step, so the renderer can blend
+//between them, and is stamped with the time the second state is due to be shown.
+struct SnapshotBuffer* snapshots;
+bool havePositions = false;	//Whether a snapshot has been acquired; until then the read buffer is all zeros
+std::thread physicsThread;
+std::atomic<bool> physicsRunning;
 
-
-
-
-struct Mesh* lattice;
-
-struct SoftBody* body;
+//The external force selected by the input, written by the render loop and read by the physics thread
+std::atomic<float> externalForceX;
+std::atomic<float> externalForceY;
 
 //glm::vec3 gravity(0.0f, -0.98f, 0.0f);
 
-double time = 0.0;
+double currentTime = 0.0;
 double timebase = 0.0;
 double accumulator = 0.0;
-double physicsStep = 0.012; // This is the number of milliseconds we intend for the physics to update.
+double physicsStep = 0.012; // This is the number of seconds we intend for the physics to update, set by the scene.
+
+//With an adaptive scene the stepper picks each step instead. The length of the last step is what the
+//renderer blends across.
+AdaptiveStepper stepper;
+bool adaptive = false;
+std::atomic<double> lastStep;
+
+//Every step taken and the input during it, so a session can be replayed by the headless runner
+StepLogWriter stepLog;
+
+//How well the physics keeps up with real time, and how long the uploads take
+SimulationMetrics metrics;
+MetricsExporter metricsExporter;
 
 #pragma endregion Base_data								  
 
@@ -155,34 +202,9 @@ void init()
 
 #pragma endregion Helper_functions
 
-///
-//Performs second order euler integration for linear motion
-//
-//Parameters:
-//	dt: The timestep
-//	body: The rigidbody being integrated
-void IntegrateLinear(float dt, RigidBody &body)
+// This runs once every frame on the render thread, GLFW input may only be read from here.
+void pollInput()
 {
-	//Calculate the current acceleration
-	body.acceleration = body.inverseMass * body.netForce;
-
-	//Calculate new position with
-	//	X = X0 + V0*dt + (1/2) * A * dt^2
-	glm::vec3 v0dT = dt * body.velocity;						//Solve for the first degree term
-	glm::vec3 aT2 = (0.5f) * body.acceleration * powf(dt, 2);	//Solve for the second degree term
-	body.position += v0dT + aT2;								//Take sum
-
-	//determine the new velocity
-	body.velocity += dt * body.acceleration + body.inverseMass * body.netImpulse;
-
-	//Zero the net impulse and net force!
-	body.netForce = body.netImpulse = glm::vec3(0.0f);
-}
-
-// This runs once every physics timestep.
-void update(float dt)
-{	
-
 	//This is the external force we will apply based on which keys are pressed.
 	glm::vec3 externalForce = glm::vec3(0.0f);
 
@@ -210,119 +232,145 @@ void update(float dt)
 		}
 	}
 
-	glm::vec3 displacement;	//The displacement between nodes
-	glm::vec3 direction;	//The direction of the displacement
-	float mag;				//The magnitude of the dispplacement
-
-	//Apply forces to each rigidbody making up the softbody
-	for(int i = 0; i < body->subdivisionsY; i++)
-	{
-
-		for(int j = 0; j < body->subdivisionsX; ++j)
-		{
-
-			//If there is a rigidbody above this one, calculate the spring force between this rigidbody and the rigidbody above
-			if(i > 0)
-			{
-				//Get displacement from rigidBody[i-1] to rigidBody[i]
-				displacement = body->bodies[i - 1][j].position - body->bodies[i][j].position;
-				//Extract the direction and the magnitude from this displacement
-				direction = glm::normalize(displacement);
-				mag = glm::length(displacement);
-
-				//Calculate and Add the applied force according the Hooke's law
-				//Fspring = -k(dX)
-				//And from that we must add the dampening force:
-				//Fdamp = -V * C 
-				//Where C is the dampening constant
-				body->bodies[i][j].netForce += body->coefficient * (mag - body->restHeight) * direction - body->bodies[i][j].velocity * body->dampening;
-			}
-
-			//If there is a rigidbody below this one, calculate the spring force between this rigidbody and the one below
-			if(i < body->subdivisionsY - 1)
-			{
-				displacement = body->bodies[i + 1][j].position - body->bodies[i][j].position;
-				direction = glm::normalize(displacement);
-				mag = glm::length(displacement);
-				body->bodies[i][j].netForce += body->coefficient * (mag - body->restHeight) * direction - body->bodies[i][j].velocity * body->dampening;
-			}
-
-			//If there is a rigidbody left of this one, calculate the spring force between this rigidbody and the one below
-			if(j > 0)
-			{
-				displacement = body->bodies[i][j - 1].position - body->bodies[i][j].position;
-				direction = glm::normalize(displacement);
-				mag = glm::length(displacement);
-				body->bodies[i][j].netForce += body->coefficient * (mag - body->restWidth) * direction - body->bodies[i][j].velocity * body->dampening;
-			}
-
-			//If there is a rigidbody right of this one, calculate the spring force between this rigidbody and the one below
-			if(j < body->subdivisionsX - 1)
-			{
-				displacement = body->bodies[i][j + 1].position - body->bodies[i][j].position;
-				direction = glm::normalize(displacement);
-				mag = glm::length(displacement);
-				body->bodies[i][j].netForce += body->coefficient * (mag - body->restWidth) * direction - body->bodies[i][j].velocity * body->dampening;
-			}
-
-			//If the vertex is on the bottom row, apply the external force
-			if(i == 0)
-				body->bodies[i][j].netForce += externalForce;
-		}
-	}
+	externalForceX.store(externalForce.x);
+	externalForceY.store(externalForce.y);
+}
 
+// This runs once every physics timestep.
+// Returns the length of the step taken, which with adaptive steps is no longer than limit.
+double update(double limit)
+{	
+	PROFILE_ZONE("update");
+	float forceX = externalForceX.load();
+	float forceY = externalForceY.load();
 
-	//Update the rigidbodies & mesh
-	//For each rigidbody
-	for(int i = 0; i < body->subdivisionsY; ++i)
+	//Solve the softbodies
+	if (adaptive)
 	{
-		for(int j = 0; j < body->subdivisionsX;++j)
-		{
-			int numVertex = i * body->subdivisionsY + j;
-			//Integrate kinematics
-			IntegrateLinear(dt, body->bodies[i][j]);
-			//And change the mesh's vertices to match this rigidbodies position
-			lattice->vertices[numVertex].x = body->bodies[i][j].position.x;
-			lattice->vertices[numVertex].y = body->bodies[i][j].position.y;
-			lattice->vertices[numVertex].z = body->bodies[i][j].position.z;
-		}
+		return stepper.Step(*world, *solver, (float)limit, forceX, forceY, &stepLog);
 	}
 
+	world->Step(*solver, (float)physicsStep, forceX, forceY);
+	stepLog.Append((float)physicsStep, forceX, forceY);
+	return physicsStep;
+}
+
+// Returns the length of the next physics step.
+double nextStep()
+{
+	return adaptive ? stepper.step : physicsStep;
 }
 
-// This runs once every frame to determine the FPS and how often to call update based on the physics step.
-void checkTime()
+// This runs on the physics thread to determine how often to call update based on the physics step.
+// Returns the number of steps taken.
+int checkTime()
 {
+	PROFILE_ZONE("checkTime");
+	int steps = 0;
+	double simulated = 0.0;
+
 	// Get the current time.
-	time = glfwGetTime();
+	currentTime = glfwGetTime();
 
 	// Get the time since we last ran an update.
-	double dt = time - timebase;
+	double dt = currentTime - timebase;
 
 	// If more time has passed than our physics timestep.
-	if (dt > physicsStep)
+	if (dt > nextStep())
 	{
 
-		timebase = time; // set new last updated time
+		timebase = currentTime; // set new last updated time
 
-		// Limit dt
+		// Limit dt, the time beyond it is never simulated
 		if (dt > 0.25)
 		{
+			metrics.droppedSeconds.Add(dt - 0.25);
+			metrics.clamps.Add(1.0);
 			dt = 0.25;
 		}
 		accumulator += dt;
 
 		// Update physics necessary amount
-		while (accumulator >= physicsStep)
+		while (accumulator >= nextStep())
 		{
-			update(physicsStep);
-			accumulator -= physicsStep;
+			//Before the last step, keep the positions to interpolate from.
+			//Adaptive steps can change length at any step, so it is never known which is last.
+			if (adaptive || accumulator < 2.0 * physicsStep)
+			{
+				PROFILE_ZONE("Vertex copy");
+				WriteVertexPositions(world->particles, 0, world->particles.count, snapshots->GetWriteBuffer(), 2);
+			}
+
+			double stepStart = glfwGetTime();
+			double taken = update(accumulator);
+			metrics.stepSeconds.Observe(glfwGetTime() - stepStart);
+
+			accumulator -= taken;
+			simulated += taken;
+			lastStep.store(taken);
+			++steps;
+		}
+
+		metrics.steps.Add(steps);
+		metrics.simulatedSeconds.Add(simulated);
+		metrics.frames.Add(1.0);
+		metrics.substeps.Observe(steps);
+		metrics.lagSeconds.Set(accumulator);
+	}
+
+	return steps;
+}
+
+// The physics thread. Steps the simulation in real time and publishes a snapshot of the positions
+// after every batch of steps, independently of how long the frames take to render.
+void physicsLoop()
+{
+	ProfilerSetThreadName("Physics");
+	timebase = glfwGetTime();
+
+	while (physicsRunning.load())
+	{
+		if (checkTime() > 0)
+		{
+			//Hand the new positions to the render loop.
+			//The leftover accumulator is how far real time has already run past the new state.
+			PROFILE_ZONE("Vertex copy");
+			unsigned int count = world->particles.count;
+			WriteVertexPositions(world->particles, 0, count, snapshots->GetWriteBuffer() + 2 * count, 2);
+			snapshots->SetWriteTime(currentTime - accumulator);
+			snapshots->Publish();
+		}
+		else
+		{
+			//Nothing due yet, sleep until the next step is
+			double wait = nextStep() - (glfwGetTime() - timebase);
+			if (wait > 0.0)
+			{
+				std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+			}
 		}
 	}
 }
 
 
 
+///
+//Blends two sets of positions
+//
+//Parameters:
+//	previous: The positions at alpha 0
+//	current: The positions at alpha 1
+//	alpha: The blend factor
+//	dest: The blended positions
+//	count: The number of floats in each set
+void interpolatePositions(const float* previous, const float* current, float alpha, float* dest, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		dest[i] = previous[i] + (current[i] - previous[i]) * alpha;
+	}
+}
+
 // This function runs every frame
 void renderScene()
 {
@@ -339,76 +387,168 @@ void renderScene()
 	//Set hue uniform
 	glUniformMatrix4fv(uniHue, 1, GL_FALSE, glm::value_ptr(hue));
 
-	//Refresh the rope vertices
-	lattice->RefreshData();
+	//Pick up the newest positions from the physics thread, if it has produced any since the last frame
+	bool fresh = snapshots->Acquire();
+	if (fresh) havePositions = true;
+
+	//Show the state between the last two physics steps that matches the current time:
+	//alpha is the leftover accumulator as a fraction of a step, which keeps growing until the next step.
+	double alpha = (glfwGetTime() - snapshots->GetReadTime()) / lastStep.load();
+	if (alpha < 0.0) alpha = 0.0;
+	if (alpha > 1.0) alpha = 1.0;
+
+	double uploadStart = glfwGetTime();
+	//Until the first snapshot arrives the mesh keeps the starting positions createWorldMesh wrote
+	if (havePositions && (fresh || alpha < 1.0))
+	{
+		PROFILE_ZONE("Interpolate");
+		unsigned int count = 2 * world->particles.count;
+		const float* positions = snapshots->GetReadBuffer();
+		interpolatePositions(positions, positions + count, (float)alpha, lattice->GetWritePositions(), count);
+		lattice->PositionsWritten();
+	}
+
+	//Refresh the lattice vertices
+	{
+		PROFILE_ZONE("RefreshData");
+		lattice->RefreshData();
+	}
+	double uploadSeconds = glfwGetTime() - uploadStart;
+
 	// Draw the Gameobjects
-	lattice->Draw();
+	{
+		PROFILE_ZONE("Draw");
+		lattice->Draw();
+	}
+	metrics.uploadSeconds.Observe(uploadSeconds);
 }
 
-#pragma endregion util_Functions
+///
+//Creates the mesh showing every lattice of a world: one vertex per particle and one quad per cell.
+//Each lattice's indices are relative to its first particle and drawn as one range of a multi-draw.
+//The indices and colours are generated straight into the mesh's buffers, so lattices of any size
+//are built without a temporary copy.
+//
+//Parameters:
+//	world: The world to show
+//	stream: Whether to stream the positions through a persistent mapped ring where the context allows
+Mesh* createWorldMesh(const World &world, bool stream)
+{
+	size_t numIndices = 0;
+	for (size_t i = 0; i < world.bodies.size(); ++i)
+	{
+		const SoftBody &body = world.bodies[i]->view;
+		numIndices += LatticeQuadIndexCount(body.subdivisionsX, body.subdivisionsY);
+	}
 
+	//The positions change every step, so stream them through a persistent mapped ring
+	unsigned int numVertices = world.particles.count;
+	Mesh* mesh = new struct Mesh((int)numVertices, (int)numIndices, GL_QUADS, stream);
 
+	GLuint* indices = mesh->MapIndices();
+	size_t firstIndex = 0;
+	for (size_t i = 0; i < world.bodies.size(); ++i)
+	{
+		const SoftBody &body = world.bodies[i]->view;
+		size_t count = LatticeQuadIndexCount(body.subdivisionsX, body.subdivisionsY);
+		WriteLatticeQuadIndices(body.subdivisionsX, body.subdivisionsY, indices + firstIndex);
+		mesh->AddDrawRange(firstIndex, (GLsizei)count, (GLint)world.bodies[i]->firstParticle);
+		firstIndex += count;
+	}
+	mesh->UnmapIndices();
 
-void main()
-{
-	glfwInit();
+	FillVertexColors(mesh->MapColors(), numVertices, 0.0f, 1.0f, 1.0f, 1.0f);
+	mesh->UnmapColors();
 
-	// Create a window
-	window = glfwCreateWindow(800, 800, "Mass Spring Softbody (2D)", nullptr, nullptr);
-	glfwMakeContextCurrent(window);
-	glfwSwapInterval(0);
+	//Show the starting positions until the physics thread publishes
+	WriteVertexPositions(world.particles, 0, numVertices, mesh->GetWritePositions(), 2);
+	mesh->PositionsWritten();
+	mesh->RefreshData();
 
-	// Initializes most things needed before the main loop
-	init();
+	return mesh;
+}
 
-	//Generate the rope mesh
-	float latticeArr[10 * 10 * (sizeof(struct Vertex) / sizeof(float))];
-	for(int i = 0; i < 10; i++)
+int main(int argc, char** argv)
+{
+	//The arguments are an optional scene file, --trace FILE to profile the run, --frames N to close after
+	//N frames, and --no-stream to upload the positions with glMapBuffer as contexts before GL 4.4 do
+	const char* scenePath = "../Scene.txt";
+	const char* tracePath = nullptr;
+	const char* metricsPath = nullptr;
+	int metricsPort = 0;
+	const char* stepLogPath = nullptr;
+	int frames = 0;
+	bool stream = true;
+	for (int i = 1; i < argc; ++i)
 	{
-		for(int j = 0; j < 10; j++)
-		{
-			int offset = sizeof(struct Vertex) / sizeof(float);
-			int index = (i * 10 + j) * offset;
-			Vertex* v = (Vertex*)(latticeArr + index);
-			v->x = (1.0f / 10.0f) * (float)j;
-			v->y = (1.0f / 10.0f) * (float)i;
-			v->z = 0.0f;
-
-			v->r = 0.0f;
-			v->g = 1.0f;
-			v->b = 1.0f;
-			v->a = 1.0f;
-		}
+		if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) tracePath = argv[++i];
+		else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) metricsPath = argv[++i];
+		else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc) metricsPort = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--step-log") == 0 && i + 1 < argc) stepLogPath = argv[++i];
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--no-stream") == 0) stream = false;
+		else scenePath = argv[i];
+	}
+
+	if (tracePath != nullptr)
+	{
+		ProfilerSetThreadName("Render");
+		ProfilerEnable(true);
 	}
 
-	Vertex *latticeVerts = (Vertex*)latticeArr;
+	//Read the scene before opening a window, so a bad one fails fast
+	std::string error;
+	if (!LoadScene(scenePath, scene, error))
+	{
+		printf("%s\n", error.c_str());
+		return 1;
+	}
+	physicsStep = scene.physicsStep;
+	lastStep.store(physicsStep);
+	adaptive = ConfigureSceneStepper(stepper, scene);
+
+	if (stepLogPath != nullptr && !stepLog.Open(stepLogPath))
+	{
+		printf("Can't write step log: %s\n", stepLogPath);
+		return 1;
+	}
 
-	const int numIndices = 9 * 9 * 4;
-	GLuint latticeElems[numIndices];
-	for(int i = 0; i < 9; i++)
+	if (metricsPath != nullptr || metricsPort > 0)
 	{
-		for(int j = 0; j < 9; j++)
+		if (!metricsExporter.Start(metrics.registry, metricsPath, metricsPort, 1.0))
 		{
-			int element = (i * 10 + j) * 4 - 4 * i;
-			latticeElems[element] = (i * 10) + j;
-			latticeElems[element + 1] = (i * 10) + (j + 1);
-			latticeElems[element + 2] = ((i + 1) * 10) + (j + 1);
-			latticeElems[element + 3] = ((i + 1) * 10) + j;
+			printf("Can't serve metrics on port %d\n", metricsPort);
+			return 1;
 		}
 	}
 
-	//lattice creation
-	lattice = new struct Mesh(10 * 10, latticeVerts, numIndices, latticeElems, GL_QUADS);
+	glfwInit();
+
+	// Create a window
+	window = glfwCreateWindow(800, 800, "Mass Spring Softbody (2D)", nullptr, nullptr);
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(0);
 
-	//Scale the lattice
-	lattice->scale = glm::scale(lattice->scale, glm::vec3(1.0f));
+	// Initializes most things needed before the main loop
+	init();
 
-	//Set spring constant, rest length, and dampening constant
-	float coeff = 25.0f;
-	float damp = 0.5f;
+	//Start the solver with the scene's threads
+	solver = new SoftBodySolver(scene.threads);
+	ConfigureSceneSolver(*solver, scene);
+	printf("Spring force kernel: %s\n", GetSpringKernelName(solver->isa));
+	printf("Solver threads: %d\n", solver->pool->numThreads);
 
-	//Generate the softbody
-	body = new SoftBody(1.0f, 1.0f, 10, 10, coeff, damp);
+	//Generate the softbodies and their mesh
+	world = new World();
+	BuildSceneWorld(scene, *world);
+	for (size_t i = 0; i < world->bodies.size(); ++i)
+	{
+		const SoftBody &body = world->bodies[i]->view;
+		printf("Lattice %d: %dx%d\n", (int)i + 1, body.subdivisionsX, body.subdivisionsY);
+	}
+	lattice = createWorldMesh(*world, stream);
+	printf("Position upload: %s\n", lattice->streaming ? "persistent mapped ring" : "glMapBuffer");
+	snapshots = new SnapshotBuffer(2 * 2 * world->particles.count);
 
 	//Print controls
 	printf("Controls:\nPress and hold the left mouse button to cause a positive constant force\n along the selected axis.\n");
@@ -416,12 +556,18 @@ void main()
 	printf("The selected axis by default is the X axis\n");
 	printf("Hold Left Shift to change the selected axis to the Y axis\n");
 	
+	//Start the physics thread
+	externalForceX.store(0.0f);
+	externalForceY.store(0.0f);
+	physicsRunning.store(true);
+	physicsThread = std::thread(physicsLoop);
 
 	// Enter the main loop.
+	int frame = 0;
 	while (!glfwWindowShouldClose(window))
 	{
-		//Check time will update the programs clock and determine if & how many times the physics must be updated
-		checkTime();
+		//Read the input for the physics thread
+		pollInput();
 
 		// Call the render function.
 		renderScene();
@@ -432,6 +578,27 @@ void main()
 
 		// Checks to see if any events are pending and then processes them.
 		glfwPollEvents();
+
+		if (frames > 0 && ++frame >= frames) glfwSetWindowShouldClose(window, GL_TRUE);
+	}
+
+	//Stop the physics thread before anything it uses is freed
+	physicsRunning.store(false);
+	physicsThread.join();
+
+	metricsExporter.Stop();
+
+	if (stepLogPath != nullptr)
+	{
+		if (stepLog.Close()) printf("Step log written to: %s\n", stepLogPath);
+		else printf("Can't write step log: %s\n", stepLogPath);
+	}
+
+	//The rings hold the last zones of every thread, so this shows the end of the run
+	if (tracePath != nullptr)
+	{
+		if (ProfilerWriteTrace(tracePath)) printf("Trace written to: %s\n", tracePath);
+		else printf("Can't write trace: %s\n", tracePath);
 	}
 
 	// After the program is over, cleanup your data!
@@ -441,9 +608,12 @@ void main()
 	// Note: If at any point you stop using a "program" or shaders, you should free the data up then and there.
 
 	delete lattice;
-	delete body;
+	delete world;
+	delete solver;
+	delete snapshots;
 
 
 	// Frees up GLFW memory
 	glfwTerminate();
+	return 0;
 }
\ No newline at end of file